@@ -0,0 +1,114 @@
+// 比较器开销基准：在同一份随机int64数据上分别用std::less、std::greater和std::function比较器完整排序，
+// 每种比较器重复若干次，输出每次耗时和中位数。
+//
+// 用法: comparator_bench <数据目录> [文件数=8] [每个文件的记录数=4194304] [内存限制MB=64] [计算线程数=1] [重复次数=3]
+//
+// 数据由固定种子生成，目录中已有大小正确的文件时直接复用，不同版本的构建测的是同一份数据。
+// 编译为模板化之前的版本（如056f041）时定义SORT_BENCH_UNTEMPLATED，只测升序：
+//   git worktree add /tmp/base 056f041
+//   g++ -std=c++20 -O3 -DNDEBUG -pthread -DSORT_BENCH_UNTEMPLATED -I/tmp/base/include bench/comparator_bench.cpp
+//       /tmp/base/src/external_merge_sort.cpp /tmp/base/src/thread_pool.cpp /tmp/base/src/small_task.cpp
+//       -o /tmp/comparator_bench_base
+// 当前版本由CMake的comparator_bench目标构建（-O3）
+
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include "external_merge_sort.h"
+
+namespace fs = std::filesystem;
+
+#ifdef SORT_BENCH_UNTEMPLATED
+using AscendingSorter = ExternalMergeSorter;
+#else
+using AscendingSorter = ExternalMergeSorter<int64_t>;
+#endif
+
+namespace {
+
+void generateData(const std::string& dir, size_t files, size_t records) {
+    fs::create_directories(dir);
+    for (size_t i = 0; i < files; ++i) {
+        std::string path = dir + "/data_" + std::to_string(i) + ".dat";
+        std::error_code ec;
+        if (fs::file_size(path, ec) == records * sizeof(int64_t)) {
+            continue;
+        }
+
+        std::mt19937_64 gen(42 + i);
+        std::vector<int64_t> data(records);
+        for (auto& value : data) {
+            value = static_cast<int64_t>(gen());
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(int64_t));
+    }
+}
+
+// 重复排序runs次，返回每次的耗时（毫秒）
+template<typename MakeSorter>
+std::vector<long long> measure(const std::string& output, size_t runs, MakeSorter make_sorter) {
+    std::vector<long long> times;
+    for (size_t i = 0; i < runs; ++i) {
+        auto sorter = make_sorter();
+        auto start = std::chrono::steady_clock::now();
+        sorter->sort();
+        times.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        fs::remove(output);
+    }
+    return times;
+}
+
+void report(const std::string& name, std::vector<long long> times) {
+    std::cout << "[bench] " << name << ":";
+    for (long long ms : times) {
+        std::cout << " " << ms;
+    }
+    std::sort(times.begin(), times.end());
+    std::cout << " ms, median " << times[times.size() / 2] << " ms" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "用法: " << argv[0]
+                  << " <数据目录> [文件数=8] [每个文件的记录数=4194304] [内存限制MB=64] [计算线程数=1] [重复次数=3]"
+                  << std::endl;
+        return 1;
+    }
+    const std::string dir = argv[1];
+    const size_t files = argc > 2 ? std::stoul(argv[2]) : 8;
+    const size_t records = argc > 3 ? std::stoul(argv[3]) : 4194304;
+    const size_t memory = (argc > 4 ? std::stoul(argv[4]) : 64) * 1024 * 1024;
+    const size_t threads = argc > 5 ? std::stoul(argv[5]) : 1;
+    const size_t runs = argc > 6 ? std::stoul(argv[6]) : 3;
+    const std::string output = dir + ".out";
+
+    generateData(dir, files, records);
+
+    report("ascending", measure(output, runs, [&] {
+        return std::make_unique<AscendingSorter>(dir, output, memory, threads);
+    }));
+
+#ifndef SORT_BENCH_UNTEMPLATED
+    report("descending (std::greater)", measure(output, runs, [&] {
+        return std::make_unique<ExternalMergeSorter<int64_t, std::greater<int64_t>>>(dir, output, memory, threads);
+    }));
+
+    using FunctionCompare = std::function<bool(const int64_t&, const int64_t&)>;
+    report("std::function", measure(output, runs, [&] {
+        return std::make_unique<ExternalMergeSorter<int64_t, FunctionCompare>>(
+            dir, output, memory, threads, 0, FunctionCompare(std::less<int64_t>()));
+    }));
+#endif
+    return 0;
+}
@@ -0,0 +1,238 @@
+#ifndef BLOCK_IO_H
+#define BLOCK_IO_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include "thread_pool.h"
+#include "coro_task.h"
+#include "file_copy.h"
+
+// 块读取器：调用方消费当前块时，I/O线程池已在后台预读下一个块（read-ahead），
+// 计算线程只有在预读尚未完成时才会等待，大量输入流可以由少量I/O线程同时服务；在协程中使用readAsync时连这种等待也变为挂起。
+// 可只读取文件中从第first个记录开始的count个记录
+template<typename T>
+class BlockReader {
+public:
+    BlockReader(const std::string& path, ThreadPool& io_pool, size_t block_elements,
+                uint64_t first = 0, uint64_t count = UINT64_MAX)
+        : path_(path), io_pool_(io_pool), block_elements_(std::max<size_t>(block_elements, 1)),
+          remaining_(count), input_(path, std::ios::binary) {
+        if (!input_.is_open()) {
+            throw std::runtime_error("无法打开文件: " + path);
+        }
+        if (first > 0) {
+            input_.seekg(static_cast<std::streamoff>(first * sizeof(T)));
+        }
+        prefetch({});
+    }
+
+    ~BlockReader() {
+        if (pending_.valid()) {
+            pending_.wait();
+        }
+    }
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // 取出下一个块放入block，block原有的缓冲区被回收用于后台预读；到达文件末尾时返回false且block为空
+    bool read(std::vector<T>& block) {
+        if (!pending_.valid()) {
+            block.clear();
+            return false;
+        }
+
+        return accept(block, pending_.get());   // 后台读失败时在此处重新抛出异常
+    }
+
+    // read的协程版本：预读尚未完成时挂起当前协程而不阻塞线程，读完后在executor上恢复
+    Task<bool> readAsync(std::vector<T>& block, ThreadPool& executor) {
+        if (!pending_.valid()) {
+            block.clear();
+            co_return false;
+        }
+        std::vector<T> next = co_await pending_.resumeOn(executor);
+        co_return accept(block, std::move(next));
+    }
+
+    // 等待后台预读结束并关闭文件
+    void close() {
+        if (pending_.valid()) {
+            pending_.wait();
+            pending_ = {};
+        }
+        input_.close();
+    }
+
+private:
+    // 换入预读好的块，block原有的缓冲区用于预读下一个块
+    bool accept(std::vector<T>& block, std::vector<T> next) {
+        if (next.empty()) {
+            block.clear();
+            return false;
+        }
+
+        std::vector<T> recycled = std::move(block);
+        block = std::move(next);
+        if (block.size() == block_elements_) {
+            prefetch(std::move(recycled));   // 块读满说明文件可能还有数据，继续预读
+        }
+        return true;
+    }
+
+    void prefetch(std::vector<T> buffer) {
+        pending_ = AsyncResult<std::vector<T>>::run(io_pool_, [this, data = std::move(buffer)]() mutable {
+            size_t wanted = static_cast<size_t>(std::min<uint64_t>(block_elements_, remaining_));
+            data.resize(wanted);
+            input_.read(reinterpret_cast<char*>(data.data()), wanted * sizeof(T));
+            if (input_.bad()) {
+                throw std::runtime_error("读取文件失败: " + path_);
+            }
+            data.resize(input_.gcount() / sizeof(T));
+            remaining_ -= data.size();
+            return std::move(data);
+        });
+    }
+
+    std::string path_;
+    ThreadPool& io_pool_;
+    size_t block_elements_;
+    uint64_t remaining_;                    // 尚未读取的记录数，只由预读任务修改
+    std::ifstream input_;
+    AsyncResult<std::vector<T>> pending_;   // 正在预读的块
+};
+
+// 块写入器：计算线程填满一个块后交给I/O线程池异步写出（write-behind），
+// 计算线程立即拿到上一次写完的空闲缓冲区继续工作，实现双缓冲；协程中使用writeAsync和closeAsync，上一个块尚未写完时挂起。
+// 已知（或能估计上界）写出的字节数时由expected_bytes给出，创建文件时一次预留，关闭时释放多预留的部分
+template<typename T>
+class BlockWriter {
+public:
+    BlockWriter(const std::string& path, ThreadPool& io_pool, uint64_t expected_bytes = 0)
+        : path_(path), io_pool_(io_pool), output_(path, std::ios::binary), preallocated_(expected_bytes > 0) {
+        if (!output_.is_open()) {
+            throw std::runtime_error("无法创建输出文件: " + path);
+        }
+        preallocateFile(path, expected_bytes);
+    }
+
+    ~BlockWriter() {
+        // 析构时不抛异常，只保证后台写任务不再访问本对象
+        if (pending_.valid()) {
+            pending_.wait();
+        }
+    }
+
+    BlockWriter(const BlockWriter&) = delete;
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+    // 提交一个块异步写出，block被替换为一个已清空的空闲缓冲区（容量保留）
+    void write(std::vector<T>& block) {
+        if (block.empty()) {
+            return;
+        }
+        submit(block, wait());   // 等待上一个块写完，保证写入顺序
+    }
+
+    // write的协程版本：上一个块尚未写完时挂起当前协程，写完后在executor上恢复
+    Task<void> writeAsync(std::vector<T>& block, ThreadPool& executor) {
+        if (block.empty()) {
+            co_return;
+        }
+        std::vector<T> spare;
+        if (pending_.valid()) {
+            spare = co_await pending_.resumeOn(executor);
+        }
+        submit(block, std::move(spare));
+    }
+
+    // 把另一个文件中[offset, offset + bytes)的字节追加到输出末尾，与write一样由I/O线程池按顺序异步执行
+    void append(const std::string& source, uint64_t offset, uint64_t bytes) {
+        if (bytes == 0) {
+            return;
+        }
+        submitCopy(source, offset, bytes, wait());
+    }
+
+    // append的协程版本
+    Task<void> appendAsync(std::string source, uint64_t offset, uint64_t bytes, ThreadPool& executor) {
+        if (bytes == 0) {
+            co_return;
+        }
+        std::vector<T> spare;
+        if (pending_.valid()) {
+            spare = co_await pending_.resumeOn(executor);
+        }
+        submitCopy(source, offset, bytes, std::move(spare));
+    }
+
+    // 等待所有块写完并关闭文件，返回最后一个块的缓冲区以便调用方复用
+    std::vector<T> close() {
+        return finish(wait());
+    }
+
+    // close的协程版本
+    Task<std::vector<T>> closeAsync(ThreadPool& executor) {
+        std::vector<T> spare;
+        if (pending_.valid()) {
+            spare = co_await pending_.resumeOn(executor);
+        }
+        co_return finish(std::move(spare));
+    }
+
+private:
+    // 提交一个块异步写出，block被替换为已清空的spare
+    void submit(std::vector<T>& block, std::vector<T> spare) {
+        spare.clear();
+        pending_ = AsyncResult<std::vector<T>>::run(io_pool_, [this, data = std::move(block)]() mutable {
+            output_.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+            if (!output_) {
+                throw std::runtime_error("写入文件失败: " + path_);
+            }
+            return std::move(data);
+        });
+        block = std::move(spare);
+    }
+
+    // 提交一次文件复制：先把已写入流的数据刷到文件，复制完成后流定位到新的文件末尾继续写
+    void submitCopy(const std::string& source, uint64_t offset, uint64_t bytes, std::vector<T> spare) {
+        pending_ = AsyncResult<std::vector<T>>::run(io_pool_, [this, source, offset, bytes,
+                                                               spare = std::move(spare)]() mutable {
+            output_.flush();
+            appendFileRange(source, offset, bytes, path_);
+            output_.seekp(0, std::ios::end);
+            if (!output_) {
+                throw std::runtime_error("写入文件失败: " + path_);
+            }
+            return std::move(spare);
+        });
+    }
+
+    // 所有块已写完：关闭文件
+    std::vector<T> finish(std::vector<T> spare) {
+        output_.close();
+        if (preallocated_) {
+            trimPreallocation(path_);
+        }
+        return spare;
+    }
+
+    std::vector<T> wait() {
+        if (!pending_.valid()) {
+            return {};
+        }
+        return pending_.get();   // 后台写失败时在此处重新抛出异常
+    }
+
+    std::string path_;
+    ThreadPool& io_pool_;
+    std::ofstream output_;
+    bool preallocated_;
+    AsyncResult<std::vector<T>> pending_;   // 正在写出的块，完成后返回其缓冲区以便复用
+};
+
+#endif // BLOCK_IO_H
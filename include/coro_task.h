@@ -0,0 +1,285 @@
+#ifndef CORO_TASK_H
+#define CORO_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "thread_pool.h"
+#include "small_task.h"
+
+// 协程执行器：归并等阶段写成协程，等待I/O完成时挂起，而不是让计算线程阻塞在future::get()上；
+// I/O线程完成读写后把协程重新提交到它所属的线程池上恢复，挂起期间该计算线程可以执行其他已就绪的协程。
+// - Task<T>：惰性启动的协程，被另一个协程co_await时开始执行，结束时对称转移回等待者（不增加调用栈深度）
+// - resumeOn(pool)：把当前协程转移到pool的工作线程上继续执行
+// - spawn(pool, task)：在pool上启动一个顶层协程，结果通过std::future交给非协程代码
+// - AsyncResult<T>：提交到某个线程池的函数的结果，既可阻塞等待，也可co_await
+// 协程帧和共享状态从BlockPool分配，不超过其分级上限时不申请堆内存。
+// GCC 12会把 co_return co_await x; 编译成恢复时执行非法指令的代码，先把co_await的结果存入局部变量再返回
+
+template<typename T = void>
+class Task;
+
+namespace coro_detail {
+
+// 协程结束时恢复等待它的协程，没有等待者时返回noop_coroutine
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        return handle.promise().continuation_;
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error_ = std::current_exception(); }
+
+    static void* operator new(size_t bytes) { return BlockPool::allocate(bytes); }
+    static void operator delete(void* ptr, size_t bytes) noexcept { BlockPool::deallocate(ptr, bytes); }
+
+    std::coroutine_handle<> continuation_ = std::noop_coroutine();
+    std::exception_ptr error_;
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    Task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+
+    T result() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*value_);
+    }
+
+    std::optional<T> value_;
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+};
+
+} // namespace coro_detail
+
+// 惰性启动的协程任务，只可移动；异常保存在协程中，由co_await处重新抛出
+template<typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = coro_detail::Promise<T>;
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&) = delete;
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    // 启动任务并挂起等待者，任务结束后等待者在任务最后所在的线程上继续执行
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation_ = awaiting;
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    friend struct coro_detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template<typename T>
+Task<T> coro_detail::Promise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> coro_detail::Promise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// co_await resumeOn(pool)：挂起当前协程，由pool的工作线程恢复
+inline auto resumeOn(ThreadPool& pool) {
+    struct Awaiter {
+        ThreadPool& pool;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { pool.post([handle] { handle.resume(); }); }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{pool};
+}
+
+namespace coro_detail {
+
+// 顶层协程：创建后立即执行，结束时自行销毁，异常全部交给promise
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+
+        static void* operator new(size_t bytes) { return BlockPool::allocate(bytes); }
+        static void operator delete(void* ptr, size_t bytes) noexcept { BlockPool::deallocate(ptr, bytes); }
+    };
+};
+
+template<typename T>
+Detached runDetached(ThreadPool& pool, Task<T> task, std::promise<T> promise) {
+    try {
+        co_await resumeOn(pool);
+        if constexpr (std::is_void_v<T>) {
+            co_await task;
+            promise.set_value();
+        } else {
+            T result = co_await task;
+            promise.set_value(std::move(result));
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace coro_detail
+
+// 在pool上启动协程，非协程代码通过返回的future等待结果。不要在pool的任务中阻塞等待该future，
+// 协程可能需要同一个线程池的线程才能继续
+template<typename T>
+std::future<T> spawn(ThreadPool& pool, Task<T> task) {
+    std::promise<T> promise(std::allocator_arg, PoolAllocator<char>());
+    std::future<T> result = promise.get_future();
+    coro_detail::runDetached(pool, std::move(task), std::move(promise));
+    return result;
+}
+
+// 在线程池上异步执行的函数的结果，只可移动。get()阻塞等待；co_await result.resumeOn(executor)
+// 在结果就绪前挂起当前协程，就绪后由完成的线程把协程提交到executor上恢复。取出结果后对象变为无效
+template<typename T>
+class AsyncResult {
+public:
+    AsyncResult() = default;
+
+    // 把f提交到pool执行，f的返回值或异常保存在返回的对象中
+    template<typename F>
+    static AsyncResult run(ThreadPool& pool, F&& f) {
+        AsyncResult result;
+        result.state_ = std::allocate_shared<State>(PoolAllocator<State>());
+        pool.post([state = result.state_, f = std::forward<F>(f)]() mutable {
+            try {
+                state->value.emplace(f());
+            } catch (...) {
+                state->error = std::current_exception();
+            }
+            state->complete();
+        });
+        return result;
+    }
+
+    bool valid() const { return state_ != nullptr; }
+
+    // 阻塞等待结果就绪
+    void wait() const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->ready_cv.wait(lock, [this] { return state_->ready; });
+    }
+
+    // 阻塞等待并取出结果，函数抛出的异常在此处重新抛出
+    T get() {
+        wait();
+        std::shared_ptr<State> state = std::move(state_);
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        return std::move(*state->value);
+    }
+
+    auto resumeOn(ThreadPool& executor) {
+        struct Awaiter {
+            AsyncResult& result;
+            ThreadPool& executor;
+
+            bool await_ready() const noexcept { return false; }
+
+            // 已经就绪时不挂起；否则登记协程，由complete()提交到executor上恢复
+            bool await_suspend(std::coroutine_handle<> handle) {
+                State& state = *result.state_;
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.ready) {
+                    return false;
+                }
+                state.waiter = handle;
+                state.executor = &executor;
+                return true;
+            }
+
+            T await_resume() { return result.get(); }
+        };
+        return Awaiter{*this, executor};
+    }
+
+private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable ready_cv;
+        bool ready = false;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> waiter;   // 挂起等待结果的协程
+        ThreadPool* executor = nullptr;   // 恢复waiter的线程池
+
+        void complete() {
+            std::coroutine_handle<> handle;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready = true;
+                handle = std::exchange(waiter, {});
+            }
+            ready_cv.notify_all();
+            if (handle) {
+                executor->post([handle] { handle.resume(); });
+            }
+        }
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+#endif // CORO_TASK_H
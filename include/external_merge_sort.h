@@ -5,18 +5,87 @@
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <queue>
+#include <deque>
+#include <optional>
+#include <span>
+#include <atomic>
+#include <cmath>
+#include <utility>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
 #include "thread_pool.h"
+#include "block_io.h"
+#include "coro_task.h"
+#include "record_key.h"
+#include "merge_cursor.h"
+#include "run_codec.h"
+#include "output_index.h"
 
-class ExternalMergeSorter {
+// 与记录类型无关的排序流程：目录遍历、任务调度、分层归并规划、线程池与统计。
+// 具体记录类型的读取、排序和归并由模板子类ExternalMergeSorter<T, Compare>实现
+class ExternalMergeSorterBase {
 public:
-    ExternalMergeSorter(const std::string& input_dir, 
-                       const std::string& output_file,
-                       size_t memory_limit = 64 * 1024 * 1024,
-                       size_t num_threads = 0); // 默认0表示自动检测CPU核心数
+    ExternalMergeSorterBase(const std::string& input_dir, 
+                            const std::string& output_file,
+                            size_t memory_limit = 64 * 1024 * 1024,
+                            size_t num_threads = 0, // 默认0表示自动检测可用CPU核心数（考虑cgroup配额）
+                            size_t io_threads = 0); // 默认0表示使用kDefaultIoThreads
+    virtual ~ExternalMergeSorterBase() = default;
 
     void sort();
 
-private:
+    // 临时目录：通常每个目录位于一块独立的设备（如一块NVMe）上。设置后run和中间归并文件不再写在输入文件
+    // 或输出文件旁，而是按轮转依次放到各目录中；中间归并时每组的输入交错取自各目录，读写带宽随设备数增加。
+    // 为空（默认）时保持原来的位置。目录不存在时创建
+    void setTempDirs(const std::vector<std::string>& dirs);
+
+    // 内存临时层：不超过max_run_bytes的小run（小文件的run、每个文件最后不满的chunk、小的中间归并结果）
+    // 放到dir中，dir应位于内存文件系统（如 /dev/shm 下的目录）上；层内文件总大小不超过budget_bytes，
+    // 超出后的小run和所有大run照常写到磁盘。大量小文件产生的小run因此不落盘，读写它们的代价只是内存复制
+    void setMemoryTempDir(const std::string& dir, uint64_t budget_bytes, uint64_t max_run_bytes = kSmallRunBytes);
+
+    // 内存临时层默认接纳的最大run
+    static constexpr uint64_t kSmallRunBytes = 1 << 20;
+
+    // I/O线程池默认大小，与存储设备的队列深度相当即可，不随CPU核心数增长
+    static constexpr size_t kDefaultIoThreads = 4;
+
+    // 最近一个阶段（sort()为多路归并阶段）中键范围与其他run不重叠、直接复制到输出而未参与归并的run数，
+    // 包括中间归并轮次中复制的run
+    uint64_t copiedRuns() const { return copied_runs_.load(); }
+
+protected:
+    // 执行器：CPU密集的阶段在计算线程池上运行，阻塞在磁盘上的阶段在I/O线程池上运行，
+    // 二者互不占用对方的线程，从而让CPU和磁盘同时保持繁忙
+    enum class Executor {
+        Compute,
+        IO
+    };
+
+    // 排序流程中的各个阶段
+    enum class Stage {
+        Presort,    // 排序单个输入文件
+        Merge,      // 多路归并
+        Read,       // 从磁盘预读下一个块
+        Write       // 将已排序的块写入磁盘
+    };
+
+    // 每个阶段声明自己运行在哪个执行器上
+    static constexpr Executor executorFor(Stage stage) {
+        return (stage == Stage::Read || stage == Stage::Write) ? Executor::IO : Executor::Compute;
+    }
+
+    ThreadPool& pool(Stage stage) {
+        return executorFor(stage) == Executor::IO ? *io_pool_ : *compute_pool_;
+    }
+
     struct ChunkInfo {
         std::string temp_file;
         size_t data_count;
@@ -26,21 +95,1282 @@ private:
     std::vector<ChunkInfo> splitAndPresort();
     
     // 处理单个文件
-    ChunkInfo processFile(const std::string& filepath);
+    virtual ChunkInfo processFile(const std::string& filepath) = 0;
     
     // 第二阶段：多路归并
     void mergeChunks(const std::vector<ChunkInfo>& chunks);
+
+    // 并行执行中间归并轮次，直到run数不超过max_runs，返回剩余的run文件。
+    // by_overlap为true时只要求overlapGroups分出的每组不超过max_runs个run：键范围互不重叠的run
+    // 在最后一轮直接复制，不需要为它们降低run数
+    std::vector<std::string> reduceRuns(const std::vector<ChunkInfo>& chunks, size_t max_runs, bool by_overlap = false);
+
+    // 按键范围把run分组：组与组之间的键范围互不重叠且按键排好序，只有组内的run需要真正归并。
+    // 默认不了解记录的键，把所有run视为一组
+    virtual std::vector<std::vector<std::string>> overlapGroups(const std::vector<std::string>& files) {
+        return {files};
+    }
+
+    // 临时文件的路径：bytes（文件大小的上界）足够小且内存临时层的预算还有余量时放入内存临时层；
+    // 否则没有临时目录时即default_path，有则按轮转选择一个临时目录。
+    // 放入目录时文件名为default_path的文件名加上全局序号，不同输入目录中的同名文件不会冲突
+    std::string tempPath(const std::string& default_path, uint64_t bytes = UINT64_MAX);
+    // files已归并完（已被删除），归还它们占用的内存临时层预算
+    void releaseTemp(const std::vector<std::string>& files);
+    // 按文件是否还存在重新统计内存临时层的占用，用于在每次排序开始时回收上一次遗留的预算
+    void reclaimMemoryTemp();
+    // 各文件大小之和，用作归并输出大小的上界
+    static uint64_t totalFileBytes(const std::vector<std::string>& files);
+    // 把run按所在的临时目录交错排列，之后按顺序切分出的每组输入取自尽量多的目录
+    void interleaveByTempDir(std::vector<std::string>& files) const;
+
+    // 执行预排序和中间归并轮次，返回留给最后一轮归并的run文件（不超过kMergeFactor个）
+    std::vector<std::string> prepareFinalRuns();
+
+    // 每轮最多合并的文件数
+    static constexpr size_t kMergeFactor = 128;
     
     // 辅助方法
     std::vector<std::string> getAllFiles(const std::string& dir) const;
-    void mergeFiles(const std::vector<std::string>& files, const std::string& output_file);
+    static void sortBySizeDescending(std::vector<std::string>& files);
+    virtual void mergeFiles(const std::vector<std::string>& files, const std::string& output_file) = 0;
+    // mergeFiles的协程版本，由中间归并轮次在计算线程池上运行：等待预读和写出时挂起，不占用计算线程。
+    // 参数按值传入，保存在协程帧中；默认在当前线程上调用mergeFiles
+    virtual Task<void> mergeFilesAsync(std::vector<std::string> files, std::string output_file);
+    // 依次领取并归并groups中尚未被领取的组（next为下一个组的下标），多个协程共享同一组任务；
+    // 参数在协程结束前必须保持有效
+    Task<void> mergeGroups(const std::vector<std::vector<std::string>>& groups, const std::vector<std::string>& outputs,
+                           std::atomic<size_t>& next);
     const double get_memory_usage_mb();
+    void resetPoolStats();
+    void printPoolStats() const;
 
     std::string input_dir_;
     std::string output_file_;
     size_t memory_limit_;
-    std::unique_ptr<ThreadPool> thread_pool_;
+    std::unique_ptr<ThreadPool> compute_pool_;   // 计算线程池，大小等于CPU核心数
+    std::unique_ptr<ThreadPool> io_pool_;        // I/O线程池，大小等于设备队列深度
     size_t num_threads_;
+    size_t io_threads_;
+    std::vector<std::string> temp_dirs_;
+    std::atomic<size_t> next_temp_{0};   // 下一个临时文件的序号
+    std::atomic<size_t> next_dir_{0};    // 下一个轮转到的临时目录
+
+    // 内存临时层：目录、预算和其中每个文件预留的字节数
+    std::string memory_dir_;
+    uint64_t memory_budget_ = 0;
+    uint64_t memory_max_run_ = 0;
+    std::mutex memory_mutex_;
+    uint64_t memory_used_ = 0;
+    std::unordered_map<std::string, uint64_t> memory_runs_;
+
+    // 当前阶段归约（去重）前后的记录数，由各阶段的任务并发累加
+    std::atomic<uint64_t> reduce_input_{0};
+    std::atomic<uint64_t> reduce_output_{0};
+    // 当前阶段键范围与其他run不重叠、直接复制而未参与归并的run数
+    std::atomic<uint64_t> copied_runs_{0};
+
+private:
+    // 在作用域内临时缩容线程池，离开作用域时（包括异常退出）恢复进入时的线程数
+    class PoolSizeScope {
+    public:
+        explicit PoolSizeScope(ThreadPool& pool) : pool_(pool), saved_(pool.size()) {}
+        ~PoolSizeScope() {
+            if (pool_.size() != saved_) {
+                pool_.resize(saved_);
+            }
+        }
+
+        PoolSizeScope(const PoolSizeScope&) = delete;
+        PoolSizeScope& operator=(const PoolSizeScope&) = delete;
+
+        // 线程数超过size时缩容到size，不扩容
+        void shrinkTo(size_t size) {
+            if (size < pool_.size()) {
+                pool_.resize(size);
+            }
+        }
+
+    private:
+        ThreadPool& pool_;
+        size_t saved_;
+    };
 };
 
-#endif // EXTERNAL_MERGE_SORT_H
\ No newline at end of file
+// 外部归并排序器，对定长、可平凡复制的记录排序。
+// Compare为编译期比较器，默认按operator<升序；对复合记录可配合KeyCompare按记录中的键比较。
+// 例如 ExternalMergeSorter<KeyValue, KeyCompare<MemberKey<&KeyValue::key>>> 按key字段排序
+template<typename T = int64_t, typename Compare = std::less<T>, typename Combiner = void>
+class ExternalMergeSorter : public ExternalMergeSorterBase {
+    static_assert(std::is_trivially_copyable_v<T>, "记录类型必须可平凡复制，才能按字节读写");
+
+public:
+    using value_type = T;
+    using value_compare = Compare;
+
+    // 等价记录的合并操作：指定Combiner时为聚合排序，否则只在去重模式下保留第一条
+    using ReduceOp = std::conditional_t<std::is_void_v<Combiner>, KeepFirst, Combiner>;
+
+    ExternalMergeSorter(const std::string& input_dir, 
+                       const std::string& output_file,
+                       size_t memory_limit = 64 * 1024 * 1024,
+                       size_t num_threads = 0,
+                       size_t io_threads = 0,
+                       Compare compare = Compare())
+        : ExternalMergeSorterBase(input_dir, output_file, memory_limit, num_threads, io_threads),
+          compare_(compare) {}
+
+    // 后台溢写任务引用了本对象，析构前必须等待其结束；未调用finish（或finish出错）时删除已溢写的run
+    ~ExternalMergeSorter() override {
+        for (auto& future : pending_spills_) {
+            try {
+                spilled_runs_.push_back(future.get());
+            } catch (...) {
+                // 溢写失败的run没有生成，析构时无法再报告错误
+            }
+        }
+        std::vector<std::string> runs;
+        for (const auto& run : spilled_runs_) {
+            std::error_code ec;
+            std::filesystem::remove(run.temp_file, ec);
+            runs.push_back(run.temp_file);
+        }
+        releaseTemp(runs);
+    }
+
+    // 拉取式输出：完成预排序和中间归并轮次后，返回最后一轮归并的游标，由调用方按块拉取排序结果，
+    // 不写output_file_；可随时close提前结束，剩余的run随之删除。游标使用本对象的I/O线程池，不能比本对象活得更久
+    MergeCursor<T, Compare, ReduceOp> sortedCursor();
+
+    // 批量回调式输出：排序结果按块交给consumer，consumer返回false时提前结束
+    using BlockConsumer = std::function<bool(const T* records, size_t count)>;
+    void sortTo(const BlockConsumer& consumer);
+
+    // 去重模式：按Compare等价的记录只保留一条。每个run写出前先去掉相邻的等价记录，
+    // 之后每次归并再去掉不同run之间的等价记录，重复越多后续各遍处理的数据越少
+    void setDistinct(bool distinct) { distinct_ = distinct; }
+
+    // 是否合并等价记录：聚合排序总是合并，否则只在去重模式下合并
+    bool reducing() const { return !std::is_void_v<Combiner> || distinct_; }
+
+    // 范围分区输出：把排序结果写成partitions个互不重叠的有序文件 output_file_.part0 ... partN-1，
+    // 前一个分区的记录都排在后一个分区之前。分区边界从run中采样得到，各分区大小大致相等；
+    // 每个分区在run中二分查找出自己的片段，由各自的计算线程归并。返回分区文件列表
+    std::vector<std::string> sortPartitioned(size_t partitions);
+
+    // 每个分区的采样数，越多分区大小越均匀
+    static constexpr size_t kSamplesPerPartition = 64;
+
+    // 压缩run：所有临时run（.sorted、.chunkN、.intermediate_*、.spillN）改用差分+varint压缩的分帧格式，
+    // 由写入run的计算线程编码、归并补充数据时解码，最终输出仍为原始格式。只支持整数记录；
+    // Top-K和范围分区需要按记录随机读取run，执行时临时使用原始格式
+    void setCompressRuns(bool compress) {
+        if (compress && !kCompressibleRun<T>) {
+            throw std::runtime_error("只有整数记录支持压缩run");
+        }
+        compress_runs_ = compress;
+    }
+
+    // 输出索引：排序结果写出时顺带生成旁路索引 output_file_.idx，之后可用SortedFileReader按键查询。
+    // 索引来自写出时收集的fence，不需要再读一遍输出；只对sort()和finish()的二进制输出生效
+    void setOutputIndex(bool build) {
+        if (build && text_output_) {
+            throw std::runtime_error("文本输出不支持输出索引");
+        }
+        output_index_ = build;
+    }
+
+    // 文本输入：输入文件为每行一个十进制整数。每个输入文件由预排序的计算线程按块解析，
+    // 块的边界对齐到换行符，解析与后台预读重叠。只支持整数记录；外部选择按文件大小计数，只支持二进制输入
+    void setTextInput(bool text) {
+        if (text && !kTextRecord<T>) {
+            throw std::runtime_error("只有整数记录支持文本输入");
+        }
+        text_input_ = text;
+    }
+
+    // 文本输出：output_file_写成每行一个十进制整数，由最后一轮归并写出块时格式化。
+    // 中间run仍为二进制格式；范围分区的分区文件和拉取式输出不受影响
+    void setTextOutput(bool text) {
+        if (text && !kTextRecord<T>) {
+            throw std::runtime_error("只有整数记录支持文本输出");
+        }
+        if (text && output_index_) {
+            throw std::runtime_error("文本输出不支持输出索引");
+        }
+        text_output_ = text;
+    }
+
+    // Top-K：只把按Compare排在最前的k个记录排好序写入output_file_，不做完整排序；
+    // 去重或聚合时为排在最前的k个键，每个键的记录合并为一条。
+    // 所有线程的候选缓冲区能放进内存时，每个输入文件只读一遍，用有界缓冲区和nth_element筛选；
+    // 否则生成run后把每个run截断到k个记录，并丢弃所有run中排在全局第k个键之后的尾部，归并只输出前k个
+    void topK(size_t k);
+
+    // 外部选择：返回按Compare排序后位于各rank（从0开始）的记录，只顺序扫描输入，不生成排好序的输出。
+    // 第一遍在全部数据上等间隔采样，用样本估计每个rank所在的键区间[lo, hi]；之后每遍精确统计
+    // 区间之前和区间内的记录数，区间内的记录能放进内存时直接nth_element，否则在区间内重新采样继续缩小
+    std::vector<T> select(const std::vector<uint64_t>& ranks);
+
+    // 分位数，q取值[0, 1]，对应排序后下标为floor(q * (n - 1))的记录
+    std::vector<T> quantiles(const std::vector<double>& qs);
+
+    // 推送式输入：生产者直接推送记录，无需先落盘成输入文件（此时input_dir可为空）。
+    // 记录先累积在内存缓冲区中，缓冲区满后在计算线程池上后台排序并溢写成run，
+    // 只有在超出内存预算时才会写临时文件；add只应由一个线程调用
+    void add(std::span<const T> records);
+
+    // 结束推送并生成输出文件：从未溢写时直接在内存中排序写出，否则归并所有run
+    void finish();
+
+    // 同时在后台溢写的缓冲区上限，达到上限时add阻塞等待最早的溢写完成（背压）
+    static constexpr size_t kMaxPendingSpills = 2;
+
+    // 记录不小于该字节数且比较器提供规范化键前缀时，预排序改为对(前缀, 下标)排序，再按顺序聚集记录写出
+    static constexpr size_t kPrefixSortMinRecordSize = 128;
+    static constexpr bool kUsePrefixSort =
+        sizeof(T) >= kPrefixSortMinRecordSize && KeyPrefixTraits<T, Compare>::available;
+
+protected:
+    ChunkInfo processFile(const std::string& filepath) override;
+    void mergeFiles(const std::vector<std::string>& files, const std::string& output_file) override;
+    Task<void> mergeFilesAsync(std::vector<std::string> files, std::string output_file) override;
+
+private:
+    // 前缀排序的排序项，16字节，远小于宽记录本身，交换代价低
+    struct PrefixEntry {
+        uint64_t prefix;
+        uint32_t index;
+    };
+
+    // 按run索引中的最小/最大记录分组；合并等价记录时端点等价的run也必须在同一组
+    std::vector<std::vector<std::string>> overlapGroups(const std::vector<std::string>& files) override;
+
+    // 排序一个缓冲区：普通模式直接排序记录，前缀排序模式只排序entries；去重模式下同时去掉等价记录
+    void sortBuffer(std::vector<T>& buffer, std::vector<PrefixEntry>& entries);
+    // 将sortBuffer排好的数据交给写入器，普通模式下buffer被替换为写入器的空闲缓冲区
+    void writeSorted(std::vector<T>& buffer, const std::vector<PrefixEntry>& entries, RunWriter<T>& writer) const;
+    // 排序一个推送缓冲区并写成文件
+    ChunkInfo sortAndWrite(std::vector<T> buffer, const std::string& filename);
+    // 提交当前推送缓冲区的后台溢写
+    void spillIngestBuffer();
+
+    // Top-K的两种实现
+    void topKInMemory(size_t k);
+    void topKExternal(size_t k);
+    // 单个文件中排在最前的k个记录（顺序任意）
+    std::vector<T> topKOfFile(const std::string& filepath, size_t k, size_t block_elements);
+    // 保留buffer中按Compare排在最前的k个记录，第k个记录位于buffer[k-1]，其余顺序任意。
+    // 合并等价记录时先排序并合并相邻的等价记录，再保留前k个（此时buffer有序）
+    void keepFirstK(std::vector<T>& buffer, size_t k);
+    // 合并已排好序的buffer中相邻的等价记录，后一条合并进前一条
+    void reduceAdjacent(std::vector<T>& buffer);
+
+    // 外部选择中一个rank的搜索区间，lo/hi为空表示不设下界/上界
+    struct SelectionBracket {
+        std::optional<T> lo;
+        std::optional<T> hi;
+        size_t stride = 1;   // 区间内每stride个记录保留一个，为1时保留区间内全部记录
+    };
+
+    // 扫描一遍输入时一个区间的统计结果
+    struct BracketScan {
+        uint64_t below = 0;      // 排在lo之前的记录数
+        uint64_t in_range = 0;   // 落在[lo, hi]内的记录数
+        std::vector<T> kept;     // 保留的区间内记录
+        bool overflow = false;   // 保留的记录超出上限，kept不完整
+    };
+
+    // 并行扫描所有输入文件，对每个区间统计并保留记录，保留全部记录的区间最多保留keep_limit个
+    std::vector<BracketScan> scanBrackets(const std::vector<std::string>& files,
+                                          const std::vector<SelectionBracket>& brackets, size_t keep_limit);
+
+    // 文件写完后调用：path是最终输出且需要输出索引时，用写出时收集的索引生成旁路索引
+    void finishOutput(const std::string& path, const RunIndex<T>& index) const {
+        if (output_index_ && path == output_file_) {
+            writeOutputIndex(path, index);
+        }
+    }
+
+    // 在作用域内临时使用原始格式的run，离开作用域时（包括抛出异常）恢复原来的压缩设置
+    class RawRunScope {
+    public:
+        explicit RawRunScope(bool& compress_runs)
+            : compress_runs_(compress_runs), saved_(std::exchange(compress_runs, false)) {}
+        ~RawRunScope() { compress_runs_ = saved_; }
+
+        RawRunScope(const RawRunScope&) = delete;
+        RawRunScope& operator=(const RawRunScope&) = delete;
+
+    private:
+        bool& compress_runs_;
+        bool saved_;
+    };
+
+    // 写入path时使用的格式：最终输出只有原始记录（或文本），其余文件都是带索引的run
+    RunFormat formatFor(const std::string& path) const {
+        if (path == output_file_) {
+            return text_output_ ? RunFormat::Text : RunFormat::Plain;
+        }
+        return compress_runs_ ? RunFormat::Compressed : RunFormat::Raw;
+    }
+
+    // 随机读取run文件中的第index个记录
+    static T readRecordAt(std::ifstream& file, uint64_t index);
+    // 在run中二分查找，返回第一个不排在key之前 / 排在key之后的记录下标；
+    // 先用索引中的fence定位到一个块，只在块内读取记录
+    uint64_t lowerBoundInRun(std::ifstream& file, const RunIndex<T>& index, const T& key) const;
+    uint64_t upperBoundInRun(std::ifstream& file, const RunIndex<T>& index, const T& key) const;
+
+    // 归并fan_in个输入流时每个流的块大小（记录数）
+    size_t mergeBlockElements(size_t fan_in) const {
+        return std::max(memory_limit_ / (fan_in * sizeof(T)) / (num_threads_ > 0 ? num_threads_ : 1) / 2,
+                        static_cast<size_t>(1));
+    }
+
+    // 前缀排序：生成并排序(前缀, 下标)对，前缀相同时回退到完整比较
+    void sortPrefixEntries(const std::vector<T>& buffer, std::vector<PrefixEntry>& entries) const;
+    // 按排好序的下标把记录聚集到小块中，交给写入器异步写出
+    void gatherAndWrite(const std::vector<T>& buffer, const std::vector<PrefixEntry>& entries,
+                        RunWriter<T>& writer) const;
+
+    // 前缀排序时聚集块的大小
+    static constexpr size_t kGatherBlockBytes = 1 << 20;
+
+    Compare compare_;
+    bool distinct_ = false;
+    bool compress_runs_ = false;
+    bool output_index_ = false;
+    bool text_input_ = false;
+    bool text_output_ = false;
+    ReduceOp combine_;
+
+    // 推送式输入的状态
+    std::vector<T> ingest_buffer_;
+    size_t ingest_capacity_ = 0;
+    std::deque<std::future<ChunkInfo>> pending_spills_;
+    std::vector<ChunkInfo> spilled_runs_;
+    bool finished_ = false;
+};
+
+// 实现模板函数
+
+template<typename T, typename Compare, typename Combiner>
+ExternalMergeSorterBase::ChunkInfo ExternalMergeSorter<T, Compare, Combiner>::processFile(const std::string& filepath) {
+    // 内存限制，普通模式三等分：正在排序的块、后台预读的下一个块、后台写出的上一个块；
+    // 前缀排序模式写出的是小的聚集块，只需容纳正在排序的块、预读块和排序项
+    const size_t thread_memory = memory_limit_ / (num_threads_ > 0 ? num_threads_ : 1);
+    size_t max_elements = kUsePrefixSort ? thread_memory / (2 * sizeof(T) + sizeof(PrefixEntry))
+                                         : thread_memory / sizeof(T) / 3;
+    max_elements = std::max(max_elements, static_cast<size_t>(1));
+    std::vector<T> buffer;
+    std::vector<PrefixEntry> entries;
+
+    // 由I/O线程池预读，排序当前块时下一个块已在读取；文本输入在本线程上解析
+    InputReader<T> input(filepath, pool(Stage::Read), max_elements, text_input_);
+
+    ChunkInfo info;
+    info.data_count = 0;
+    
+    size_t chunk_index = 0;
+    
+    // 存储所有中间chunk文件
+    std::vector<std::string> chunk_files;
+    std::unique_ptr<RunWriter<T>> writer;   // 上一个chunk的写入器，可能仍在后台写出
+    
+    // 读取一批数据到缓冲区
+    while (input.read(buffer)) {
+        info.data_count += buffer.size();
+        
+        // 排序缓冲区内的数据
+        sortBuffer(buffer, entries);
+        
+        // 将排序后的数据交给I/O线程池写入临时chunk文件，同时继续读取下一批数据
+        std::string chunk_filename = tempPath(filepath + ".sorted.chunk" + std::to_string(chunk_index++),
+                                              buffer.size() * sizeof(T));
+        chunk_files.push_back(chunk_filename);
+        
+        std::vector<T> recycled;
+        if (writer) {
+            recycled = writer->close();   // 等待上一个chunk写完，回收其缓冲区
+        }
+        writer = std::make_unique<RunWriter<T>>(chunk_filename, pool(Stage::Write), formatFor(chunk_filename),
+                                                buffer.size() * sizeof(T));
+        writeSorted(buffer, entries, *writer);
+        if (!kUsePrefixSort) {
+            buffer = std::move(recycled);   // 前缀排序模式下buffer未交给写入器，下一轮直接复用
+        }
+    }
+    
+    input.close();
+    if (writer) {
+        writer->close();
+    }
+    // 释放缓冲区内存
+    buffer.clear();
+    buffer.shrink_to_fit();
+    
+    // 合并所有生成的chunk文件
+    if (chunk_files.size() == 1) {
+        // 只有一个chunk，它就是这个文件的run
+        info.temp_file = chunk_files[0];
+        return info;
+    }
+
+    info.temp_file = tempPath(filepath + ".sorted", info.data_count * sizeof(T));
+    if (chunk_files.empty()) {
+        // 空文件，生成一个只有索引的空run
+        RunWriter<T>(info.temp_file, pool(Stage::Write), formatFor(info.temp_file)).close();
+    }
+    else {
+        // 多个chunk，需要进行内部归并
+        mergeFiles(chunk_files, info.temp_file);
+        releaseTemp(chunk_files);
+    }
+    
+    return info;
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::sortBuffer(std::vector<T>& buffer, std::vector<PrefixEntry>& entries) {
+    if constexpr (kUsePrefixSort) {
+        sortPrefixEntries(buffer, entries);
+    } else {
+        std::sort(buffer.begin(), buffer.end(), compare_);
+    }
+
+    if (!reducing()) {
+        return;
+    }
+
+    // 已排好序，等价记录相邻：前一条不排在后一条之前即等价，后一条合并进前一条
+    reduce_input_ += buffer.size();
+    if constexpr (kUsePrefixSort) {
+        size_t kept = 0;
+        for (size_t i = 1; i < entries.size(); ++i) {
+            T& acc = buffer[entries[kept].index];
+            if (entries[kept].prefix == entries[i].prefix && !compare_(acc, buffer[entries[i].index])) {
+                combine_(acc, buffer[entries[i].index]);
+            } else {
+                entries[++kept] = entries[i];
+            }
+        }
+        entries.resize(std::min(entries.size(), kept + 1));
+        reduce_output_ += entries.size();
+    } else {
+        reduceAdjacent(buffer);
+        reduce_output_ += buffer.size();
+    }
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::reduceAdjacent(std::vector<T>& buffer) {
+    size_t kept = 0;
+    for (size_t i = 1; i < buffer.size(); ++i) {
+        if (!compare_(buffer[kept], buffer[i])) {
+            combine_(buffer[kept], buffer[i]);
+        } else {
+            buffer[++kept] = buffer[i];
+        }
+    }
+    buffer.resize(std::min(buffer.size(), kept + 1));
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::writeSorted(std::vector<T>& buffer, const std::vector<PrefixEntry>& entries,
+                                                  RunWriter<T>& writer) const {
+    if constexpr (kUsePrefixSort) {
+        gatherAndWrite(buffer, entries, writer);
+    } else {
+        writer.write(buffer);
+    }
+}
+
+template<typename T, typename Compare, typename Combiner>
+ExternalMergeSorterBase::ChunkInfo ExternalMergeSorter<T, Compare, Combiner>::sortAndWrite(std::vector<T> buffer,
+                                                                                 const std::string& filename) {
+    ChunkInfo info{filename, buffer.size()};
+    std::vector<PrefixEntry> entries;
+    sortBuffer(buffer, entries);
+
+    RunWriter<T> writer(filename, pool(Stage::Write), formatFor(filename), info.data_count * sizeof(T));
+    writeSorted(buffer, entries, writer);
+    writer.close();
+    finishOutput(filename, writer.index());
+    return info;
+}
+
+template<typename T, typename Compare, typename Combiner>
+auto ExternalMergeSorter<T, Compare, Combiner>::sortedCursor() -> MergeCursor<T, Compare, ReduceOp> {
+    std::vector<std::string> runs = prepareFinalRuns();
+    return MergeCursor<T, Compare, ReduceOp>(runs, pool(Stage::Read), mergeBlockElements(std::max<size_t>(runs.size(), 1)),
+                                   compare_, reducing());
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::sortTo(const BlockConsumer& consumer) {
+    MergeCursor<T, Compare, ReduceOp> cursor = sortedCursor();
+
+    std::cout << "开始最后一轮归并，结果直接交给调用方..." << std::endl;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    size_t delivered = 0;
+
+    std::vector<T> block;
+    while (cursor.next(block)) {
+        delivered += block.size();
+        if (!consumer(block.data(), block.size())) {
+            std::cout << "调用方提前结束，已输出记录数: " << delivered << std::endl;
+            break;
+        }
+    }
+    cursor.close();
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    std::cout << "最后一轮归并完成，耗时: " << duration.count() << "ms，输出记录数: " << delivered << std::endl;
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::topK(size_t k) {
+    std::cout << "开始Top-K，K=" << k << std::endl;
+    resetPoolStats();
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // 每个线程的候选缓冲区最多容纳2k个记录，合计不超过内存限制的一半时走单遍筛选
+    const size_t threads = num_threads_ > 0 ? num_threads_ : 1;
+    if (k == 0 || k <= memory_limit_ / 2 / threads / (2 * sizeof(T))) {
+        topKInMemory(k);
+    } else {
+        topKExternal(k);
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    std::cout << "Top-K完成，耗时: " << duration.count() << "ms，结果保存至: " << output_file_ << std::endl;
+    printPoolStats();
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::keepFirstK(std::vector<T>& buffer, size_t k) {
+    if (reducing()) {
+        // 前k个键的所有记录都要合并进结果，不能只按记录截断
+        std::sort(buffer.begin(), buffer.end(), compare_);
+        reduceAdjacent(buffer);
+        buffer.resize(std::min(buffer.size(), k));
+        return;
+    }
+    if (buffer.size() > k) {
+        std::nth_element(buffer.begin(), buffer.begin() + (k - 1), buffer.end(), compare_);
+        buffer.resize(k);
+    }
+}
+
+template<typename T, typename Compare, typename Combiner>
+std::vector<T> ExternalMergeSorter<T, Compare, Combiner>::topKOfFile(const std::string& filepath, size_t k,
+                                                           size_t block_elements) {
+    InputReader<T> input(filepath, pool(Stage::Read), block_elements, text_input_);
+
+    // 候选缓冲区攒满2k个记录时截断回k个，此后不排在当前第k个记录之前的记录直接跳过；
+    // 缓冲区预留了2k的容量，截断后buffer[k-1]在下一次截断前保持不变。
+    // 合并等价记录时截断回k个键，与第k个键等价的记录也要保留，之后与它合并
+    std::vector<T> best;
+    best.reserve(2 * k);
+    bool full = false;
+
+    std::vector<T> block;
+    while (input.read(block)) {
+        for (const T& record : block) {
+            if (full && (reducing() ? compare_(best[k - 1], record) : !compare_(record, best[k - 1]))) {
+                continue;
+            }
+            best.push_back(record);
+            if (best.size() == 2 * k) {
+                keepFirstK(best, k);
+                full = best.size() == k;
+            }
+        }
+    }
+    input.close();
+
+    keepFirstK(best, k);
+    return best;
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::topKInMemory(size_t k) {
+    auto files = getAllFiles(input_dir_);
+    sortBySizeDescending(files);
+
+    // 内存限制的一半留给候选缓冲区，另一半给各线程的预读块
+    const size_t threads = num_threads_ > 0 ? num_threads_ : 1;
+    const size_t block_elements = std::max(memory_limit_ / 2 / threads / sizeof(T) / 2, static_cast<size_t>(1));
+
+    std::vector<std::future<std::vector<T>>> futures;
+    if (k > 0) {
+        for (const auto& file : files) {
+            futures.push_back(pool(Stage::Presort).submit([this, file, k, block_elements]() {
+                return topKOfFile(file, k, block_elements);
+            }));
+        }
+    }
+
+    // 按提交顺序合并各文件的候选，合并缓冲区同样只保留k个
+    std::vector<T> best;
+    best.reserve(2 * k);
+    for (auto& future : futures) {
+        std::vector<T> candidates = future.get();
+        for (const T& record : candidates) {
+            best.push_back(record);
+            if (best.size() == 2 * k) {
+                keepFirstK(best, k);
+            }
+        }
+    }
+    keepFirstK(best, k);
+    std::sort(best.begin(), best.end(), compare_);
+
+    RunWriter<T> output(output_file_, pool(Stage::Write), formatFor(output_file_), best.size() * sizeof(T));
+    output.write(best);
+    output.close();
+}
+
+template<typename T, typename Compare, typename Combiner>
+T ExternalMergeSorter<T, Compare, Combiner>::readRecordAt(std::ifstream& file, uint64_t index) {
+    T record;
+    file.seekg(static_cast<std::streamoff>(index * sizeof(T)));
+    file.read(reinterpret_cast<char*>(&record), sizeof(T));
+    if (!file) {
+        throw std::runtime_error("读取run记录失败，下标: " + std::to_string(index));
+    }
+    return record;
+}
+
+template<typename T, typename Compare, typename Combiner>
+uint64_t ExternalMergeSorter<T, Compare, Combiner>::lowerBoundInRun(std::ifstream& file, const RunIndex<T>& index,
+                                                                    const T& key) const {
+    auto [low, high] = index.locate(key, compare_, false);
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (compare_(readRecordAt(file, mid), key)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+template<typename T, typename Compare, typename Combiner>
+uint64_t ExternalMergeSorter<T, Compare, Combiner>::upperBoundInRun(std::ifstream& file, const RunIndex<T>& index,
+                                                                    const T& key) const {
+    auto [low, high] = index.locate(key, compare_, true);
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (compare_(key, readRecordAt(file, mid))) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+template<typename T, typename Compare, typename Combiner>
+std::vector<std::string> ExternalMergeSorter<T, Compare, Combiner>::sortPartitioned(size_t partitions) {
+    if (partitions == 0) {
+        throw std::runtime_error("分区数必须大于0");
+    }
+
+    // 采样和二分查找需要按记录随机读取run，本次使用原始格式
+    RawRunScope raw_runs(compress_runs_);
+    std::vector<std::string> runs = prepareFinalRuns();
+
+    std::cout << "开始范围分区归并，分区数: " << partitions << std::endl;
+    resetPoolStats();
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // 记录数和fence都在run的索引中，无需扫描
+    std::vector<RunIndex<T>> indexes;
+    std::vector<uint64_t> lengths;
+    uint64_t total = 0;
+    for (const auto& run : runs) {
+        indexes.push_back(RunIndex<T>::load(run));
+        lengths.push_back(indexes.back().count);
+        total += lengths.back();
+    }
+
+    // 在所有run中按相同步长等间隔采样，样本的分位点即分区边界
+    const uint64_t step = std::max<uint64_t>(total / (partitions * kSamplesPerPartition), 1);
+    std::vector<T> samples;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        std::ifstream file(runs[r], std::ios::binary);
+        for (uint64_t index = step / 2; index < lengths[r]; index += step) {
+            samples.push_back(readRecordAt(file, index));
+        }
+    }
+    std::sort(samples.begin(), samples.end(), compare_);
+
+    std::vector<T> splitters;
+    for (size_t i = 1; i < partitions && !samples.empty(); ++i) {
+        splitters.push_back(samples[i * samples.size() / partitions]);
+    }
+
+    // 每个run中各分区的起点：第i个分区为[bounds[i], bounds[i+1])，等价的记录落在同一个分区
+    std::vector<std::vector<uint64_t>> bounds(runs.size());
+    for (size_t r = 0; r < runs.size(); ++r) {
+        std::ifstream file(runs[r], std::ios::binary);
+        bounds[r].push_back(0);
+        for (const T& splitter : splitters) {
+            bounds[r].push_back(lowerBoundInRun(file, indexes[r], splitter));
+        }
+        while (bounds[r].size() <= partitions) {
+            bounds[r].push_back(lengths[r]);
+        }
+    }
+
+    // 每个分区归并各run中属于自己的片段，互不依赖，并行执行
+    std::vector<std::string> outputs;
+    std::vector<std::future<void>> futures;
+    const size_t block_elements = mergeBlockElements(std::max<size_t>(runs.size(), 1));
+    for (size_t i = 0; i < partitions; ++i) {
+        outputs.push_back(output_file_ + ".part" + std::to_string(i));
+
+        std::vector<RunSlice> slices;
+        uint64_t records = 0;
+        for (size_t r = 0; r < runs.size(); ++r) {
+            if (bounds[r][i + 1] > bounds[r][i]) {
+                slices.push_back({runs[r], bounds[r][i], bounds[r][i + 1] - bounds[r][i]});
+                records += slices.back().count;
+            }
+        }
+
+        futures.push_back(pool(Stage::Merge).submit([this, slices = std::move(slices), output_file = outputs.back(),
+                                                     block_elements, records]() {
+            MergeCursor<T, Compare, ReduceOp> cursor(slices, pool(Stage::Read), block_elements, compare_, reducing());
+            BlockWriter<T> output(output_file, pool(Stage::Write), records * sizeof(T));
+            std::vector<T> block;
+            while (cursor.next(block)) {
+                output.write(block);
+            }
+            output.close();
+
+            if (reducing()) {
+                reduce_input_ += cursor.consumedRecords();
+                reduce_output_ += cursor.emittedRecords();
+            }
+        }));
+    }
+
+    for (auto& future : futures) {
+        future.get();
+    }
+    for (const auto& run : runs) {
+        std::filesystem::remove(run);
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    std::cout << "范围分区归并完成，耗时: " << duration.count() << "ms" << std::endl;
+    printPoolStats();
+    return outputs;
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::topKExternal(size_t k) {
+    // 截断和二分查找需要按记录随机读取run，本次使用原始格式
+    RawRunScope raw_runs(compress_runs_);
+    std::vector<ChunkInfo> chunks = splitAndPresort();
+
+    // 每个run只有前k个记录可能进入结果；任何一个满k个记录的run的第k个记录都是全局第k个记录的上界
+    std::optional<T> bound;
+    for (auto& chunk : chunks) {
+        chunk.data_count = RunIndex<T>::load(chunk.temp_file).count;   // 去重模式下少于输入记录数
+        if (chunk.data_count >= k) {
+            truncateRun<T>(chunk.temp_file, k);
+            chunk.data_count = k;
+
+            std::ifstream file(chunk.temp_file, std::ios::binary);
+            T last = readRecordAt(file, k - 1);
+            if (!bound || compare_(last, *bound)) {
+                bound = last;
+            }
+        }
+    }
+
+    // 用上界二分查找每个run的截断位置，丢弃排在上界之后的尾部
+    size_t kept = 0;
+    if (bound) {
+        for (auto& chunk : chunks) {
+            std::ifstream file(chunk.temp_file, std::ios::binary);
+            uint64_t low = upperBoundInRun(file, RunIndex<T>::load(chunk.temp_file), *bound);
+            file.close();
+            if (low < chunk.data_count) {
+                truncateRun<T>(chunk.temp_file, low);
+                chunk.data_count = low;
+            }
+            kept += chunk.data_count;
+        }
+        std::cout << "Top-K截断后保留的候选记录数: " << kept << std::endl;
+    }
+
+    // 归并截断后的run，只输出前k个记录
+    std::vector<std::string> runs = reduceRuns(chunks, kMergeFactor);
+    MergeCursor<T, Compare, ReduceOp> cursor(runs, pool(Stage::Read), mergeBlockElements(std::max<size_t>(runs.size(), 1)),
+                                   compare_, reducing());
+    RunWriter<T> output(output_file_, pool(Stage::Write), formatFor(output_file_));
+    size_t remaining = k;
+    std::vector<T> block;
+    while (remaining > 0 && cursor.next(block)) {
+        if (block.size() > remaining) {
+            block.resize(remaining);
+        }
+        remaining -= block.size();
+        output.write(block);
+    }
+    cursor.close();
+    output.close();
+}
+
+template<typename T, typename Compare, typename Combiner>
+std::vector<typename ExternalMergeSorter<T, Compare, Combiner>::BracketScan> ExternalMergeSorter<T, Compare, Combiner>::scanBrackets(
+    const std::vector<std::string>& files, const std::vector<SelectionBracket>& brackets, size_t keep_limit) {
+    const size_t threads = num_threads_ > 0 ? num_threads_ : 1;
+    const size_t block_elements = std::max(memory_limit_ / 4 / threads / sizeof(T), static_cast<size_t>(1));
+
+    // 所有文件共享每个区间的保留计数，超出上限后停止保留
+    std::unique_ptr<std::atomic<size_t>[]> kept_total(new std::atomic<size_t>[brackets.size()]);
+    for (size_t i = 0; i < brackets.size(); ++i) {
+        kept_total[i] = 0;
+    }
+
+    std::vector<std::future<std::vector<BracketScan>>> futures;
+    for (const auto& file : files) {
+        futures.push_back(pool(Stage::Presort).submit([&, file]() {
+            std::vector<BracketScan> result(brackets.size());
+            std::vector<size_t> seen(brackets.size(), 0);   // 区间内的记录计数，用于等间隔采样
+
+            BlockReader<T> input(file, pool(Stage::Read), block_elements);
+            std::vector<T> block;
+            while (input.read(block)) {
+                for (const T& record : block) {
+                    for (size_t i = 0; i < brackets.size(); ++i) {
+                        const SelectionBracket& bracket = brackets[i];
+                        if (bracket.lo && compare_(record, *bracket.lo)) {
+                            result[i].below++;
+                        } else if (!bracket.hi || !compare_(*bracket.hi, record)) {
+                            result[i].in_range++;
+                            if (seen[i]++ % bracket.stride == 0 && !result[i].overflow) {
+                                // 样本数量由stride约束，只对保留全部记录的区间限制上限
+                                if (bracket.stride > 1 ||
+                                    kept_total[i].fetch_add(1, std::memory_order_relaxed) < keep_limit) {
+                                    result[i].kept.push_back(record);
+                                } else {
+                                    result[i].overflow = true;
+                                    result[i].kept = std::vector<T>();
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            input.close();
+            return result;
+        }));
+    }
+
+    std::vector<BracketScan> total(brackets.size());
+    for (auto& future : futures) {
+        std::vector<BracketScan> partial = future.get();
+        for (size_t i = 0; i < brackets.size(); ++i) {
+            total[i].below += partial[i].below;
+            total[i].in_range += partial[i].in_range;
+            total[i].overflow = total[i].overflow || partial[i].overflow;
+            if (!total[i].overflow) {
+                total[i].kept.insert(total[i].kept.end(), partial[i].kept.begin(), partial[i].kept.end());
+            }
+        }
+    }
+    for (auto& scan : total) {
+        if (scan.overflow) {
+            scan.kept = std::vector<T>();
+        }
+    }
+    return total;
+}
+
+template<typename T, typename Compare, typename Combiner>
+std::vector<T> ExternalMergeSorter<T, Compare, Combiner>::select(const std::vector<uint64_t>& ranks) {
+    if (text_input_) {
+        throw std::runtime_error("外部选择只支持二进制输入");
+    }
+    auto files = getAllFiles(input_dir_);
+    sortBySizeDescending(files);
+
+    // 定长记录，总数由文件大小直接得到，无需额外扫描
+    uint64_t total = 0;
+    for (const auto& file : files) {
+        total += std::filesystem::file_size(file) / sizeof(T);
+    }
+    for (uint64_t rank : ranks) {
+        if (rank >= total) {
+            throw std::runtime_error("rank超出记录总数: " + std::to_string(rank) + " >= " + std::to_string(total));
+        }
+    }
+
+    std::cout << "开始外部选择，记录总数: " << total << "，rank数: " << ranks.size() << std::endl;
+    resetPoolStats();
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // 每个rank的候选和样本上限，内存限制的一半平分给所有rank
+    const size_t keep_limit = std::max(memory_limit_ / 2 / sizeof(T) / std::max<size_t>(ranks.size(), 1),
+                                       static_cast<size_t>(64));
+
+    // 每个rank的搜索状态：当前区间、区间之前的记录数以及区间内记录数的估计值；
+    // prev为上一个确认包含目标的区间，新区间估计失误时回退到它与新区间的边界之间
+    struct Target {
+        SelectionBracket bracket;
+        SelectionBracket prev;
+        uint64_t estimate;
+        uint64_t prev_in_range;
+        size_t margin_scale = 1;
+        bool done = false;
+    };
+    std::vector<Target> targets(ranks.size());
+    for (auto& target : targets) {
+        target.estimate = total;
+        target.prev_in_range = total;
+    }
+
+    std::vector<T> answers(ranks.size());
+    size_t remaining = ranks.size();
+    for (size_t pass = 1; remaining > 0; ++pass) {
+        std::vector<SelectionBracket> brackets;
+        std::vector<size_t> active;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (!targets[i].done) {
+                // 预计区间内记录放得下时全部保留，否则等间隔采样约keep_limit个
+                targets[i].bracket.stride = std::max<uint64_t>((targets[i].estimate + keep_limit - 1) / keep_limit, 1);
+                brackets.push_back(targets[i].bracket);
+                active.push_back(i);
+            }
+        }
+
+        std::cout << "外部选择第" << pass << "遍扫描，未确定的rank数: " << active.size() << std::endl;
+        std::vector<BracketScan> scans = scanBrackets(files, brackets, keep_limit);
+
+        for (size_t j = 0; j < active.size(); ++j) {
+            Target& target = targets[active[j]];
+            BracketScan& scan = scans[j];
+            const uint64_t rank = ranks[active[j]];
+
+            if (rank < scan.below) {
+                // 目标在区间之前：回退到上一个区间的下界与当前下界之间，并放宽下次的边距
+                target.bracket = {target.prev.lo, target.bracket.lo, 1};
+                target.estimate = target.prev_in_range;
+                target.margin_scale *= 2;
+                continue;
+            }
+            if (rank >= scan.below + scan.in_range) {
+                target.bracket = {target.bracket.hi, target.prev.hi, 1};
+                target.estimate = target.prev_in_range;
+                target.margin_scale *= 2;
+                continue;
+            }
+
+            if (target.bracket.lo && target.bracket.hi && !compare_(*target.bracket.lo, *target.bracket.hi)) {
+                // 区间两端等价（大量重复键），区间内的记录都与目标等价
+                answers[active[j]] = *target.bracket.lo;
+                target.done = true;
+                remaining--;
+                continue;
+            }
+
+            target.prev = target.bracket;
+            target.prev_in_range = scan.in_range;
+            target.estimate = scan.in_range;
+            if (scan.overflow) {
+                // 区间内的记录数已精确得知，下一遍按实际数量重新采样
+                continue;
+            }
+
+            const uint64_t offset = rank - scan.below;
+            if (target.bracket.stride == 1) {
+                // 区间内的记录全部在内存中，直接选出目标
+                std::nth_element(scan.kept.begin(), scan.kept.begin() + offset, scan.kept.end(), compare_);
+                answers[active[j]] = scan.kept[offset];
+                target.done = true;
+                remaining--;
+                continue;
+            }
+
+            // 用样本估计目标在样本中的位置，两侧各留约3倍标准差的边距作为新区间
+            std::sort(scan.kept.begin(), scan.kept.end(), compare_);
+            const size_t samples = scan.kept.size();
+            const size_t position = std::min<size_t>(offset / target.bracket.stride, samples - 1);
+            const size_t margin = (3 * static_cast<size_t>(std::sqrt(static_cast<double>(samples))) + 1) *
+                                  target.margin_scale;
+            if (position >= margin) {
+                target.bracket.lo = scan.kept[position - margin];
+            }
+            if (position + margin < samples) {
+                target.bracket.hi = scan.kept[position + margin];
+            }
+            target.estimate = std::min<uint64_t>((2 * margin + 1) * target.bracket.stride, scan.in_range);
+        }
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    std::cout << "外部选择完成，耗时: " << duration.count() << "ms" << std::endl;
+    printPoolStats();
+    return answers;
+}
+
+template<typename T, typename Compare, typename Combiner>
+std::vector<T> ExternalMergeSorter<T, Compare, Combiner>::quantiles(const std::vector<double>& qs) {
+    uint64_t total = 0;
+    for (const auto& file : getAllFiles(input_dir_)) {
+        total += std::filesystem::file_size(file) / sizeof(T);
+    }
+    if (total == 0) {
+        throw std::runtime_error("输入为空，无法计算分位数");
+    }
+
+    std::vector<uint64_t> ranks;
+    for (double q : qs) {
+        if (q < 0.0 || q > 1.0) {
+            throw std::runtime_error("分位数必须在[0, 1]之间: " + std::to_string(q));
+        }
+        ranks.push_back(static_cast<uint64_t>(q * static_cast<double>(total - 1)));
+    }
+    return select(ranks);
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::add(std::span<const T> records) {
+    if (finished_) {
+        throw std::runtime_error("finish之后不能再推送数据");
+    }
+    if (ingest_capacity_ == 0) {
+        // 当前缓冲区与后台溢写中的缓冲区共同分摊内存预算
+        ingest_capacity_ = std::max(memory_limit_ / sizeof(T) / (kMaxPendingSpills + 1), static_cast<size_t>(1));
+        ingest_buffer_.reserve(ingest_capacity_);
+    }
+
+    while (!records.empty()) {
+        size_t n = std::min(records.size(), ingest_capacity_ - ingest_buffer_.size());
+        ingest_buffer_.insert(ingest_buffer_.end(), records.begin(), records.begin() + n);
+        records = records.subspan(n);
+
+        if (ingest_buffer_.size() >= ingest_capacity_) {
+            spillIngestBuffer();
+        }
+    }
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::spillIngestBuffer() {
+    // 背压：后台溢写达到上限时等待最早的一个完成
+    while (pending_spills_.size() >= kMaxPendingSpills) {
+        spilled_runs_.push_back(pending_spills_.front().get());
+        pending_spills_.pop_front();
+    }
+
+    std::string filename = tempPath(output_file_ + ".spill" + std::to_string(spilled_runs_.size() + pending_spills_.size()),
+                                    ingest_buffer_.size() * sizeof(T));
+    pending_spills_.push_back(pool(Stage::Presort).submit(
+        [this, buffer = std::move(ingest_buffer_), filename]() mutable {
+            return sortAndWrite(std::move(buffer), filename);
+        }));
+
+    ingest_buffer_ = std::vector<T>();
+    ingest_buffer_.reserve(ingest_capacity_);
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::finish() {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+
+    if (pending_spills_.empty() && spilled_runs_.empty()) {
+        // 数据完全在内存预算内，排序后直接写出输出文件，不产生任何临时文件
+        sortAndWrite(std::move(ingest_buffer_), output_file_);
+        std::cout << "流式排序完成（未溢写），结果保存至: " << output_file_ << std::endl;
+        return;
+    }
+
+    if (!ingest_buffer_.empty()) {
+        spillIngestBuffer();
+    }
+    for (auto& future : pending_spills_) {
+        spilled_runs_.push_back(future.get());
+    }
+    pending_spills_.clear();
+
+    std::cout << "流式输入溢写run数: " << spilled_runs_.size() << "，开始多路归并..." << std::endl;
+    mergeChunks(spilled_runs_);   // 只有一个原始格式的run时由mergeFiles直接移动为输出文件
+    spilled_runs_.clear();
+    std::cout << "流式排序完成，结果保存至: " << output_file_ << std::endl;
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::sortPrefixEntries(const std::vector<T>& buffer,
+                                                         std::vector<PrefixEntry>& entries) const {
+    if (buffer.size() > UINT32_MAX) {
+        throw std::runtime_error("前缀排序的单个块记录数超出32位下标范围");
+    }
+
+    entries.resize(buffer.size());
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        entries[i] = {KeyPrefixTraits<T, Compare>::prefix(compare_, buffer[i]), static_cast<uint32_t>(i)};
+    }
+
+    std::sort(entries.begin(), entries.end(), [this, &buffer](const PrefixEntry& a, const PrefixEntry& b) {
+        if (a.prefix != b.prefix) {
+            return a.prefix < b.prefix;   // 绝大多数比较在此结束，无需访问记录本身
+        }
+        return compare_(buffer[a.index], buffer[b.index]);
+    });
+}
+
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::gatherAndWrite(const std::vector<T>& buffer,
+                                                      const std::vector<PrefixEntry>& entries,
+                                                      RunWriter<T>& writer) const {
+    const size_t block_elements = std::max(kGatherBlockBytes / sizeof(T), static_cast<size_t>(1));
+    std::vector<T> block;
+    block.reserve(block_elements);
+
+    for (const auto& entry : entries) {
+        block.push_back(buffer[entry.index]);
+        if (block.size() >= block_elements) {
+            writer.write(block);
+            block.reserve(block_elements);
+        }
+    }
+    writer.write(block);
+}
+
+template<typename T, typename Compare, typename Combiner>
+std::vector<std::vector<std::string>> ExternalMergeSorter<T, Compare, Combiner>::overlapGroups(
+    const std::vector<std::string>& files) {
+    struct Range {
+        T min;
+        T max;
+        const std::string* path;
+    };
+    std::vector<std::vector<std::string>> groups;
+    std::vector<Range> ranges;
+    for (const auto& file : files) {
+        RunIndex<T> index = RunIndex<T>::load(file);
+        if (index.count == 0) {
+            groups.push_back({file});   // 空run与任何run都不重叠
+        } else {
+            ranges.push_back({index.min, index.max, &file});
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [this](const Range& a, const Range& b) { return compare_(a.min, b.min); });
+
+    // 按最小记录扫描，与当前组的最大记录重叠则并入当前组，否则开始新的一组
+    std::optional<T> group_max;
+    for (const Range& range : ranges) {
+        bool overlaps = group_max && (compare_(range.min, *group_max) ||
+                                      (reducing() && !compare_(*group_max, range.min)));
+        if (!overlaps) {
+            groups.emplace_back();
+            group_max = range.max;
+        } else if (compare_(*group_max, range.max)) {
+            group_max = range.max;
+        }
+        groups.back().push_back(*range.path);
+    }
+    return groups;
+}
+
+// 多路归并多个已排序的文件到输出文件并删除中间排序文件。
+// 先按键范围分组：只有一个run的组直接复制到输出（reflink或copy_file_range），其余的组逐组归并，组之间按键顺序拼接
+template<typename T, typename Compare, typename Combiner>
+void ExternalMergeSorter<T, Compare, Combiner>::mergeFiles(const std::vector<std::string>& files, const std::string& output_file) {
+    if (files.empty()) {
+        return;
+    }
+
+    if (files.size() == 1 && formatFor(output_file) == RunFormat::Plain) {
+        // 单个原始格式的run去掉末尾的索引即为二进制输出：移动文件后截断，不复制任何数据
+        RunIndex<T> index = RunIndex<T>::load(files[0]);
+        if (!index.compressed) {
+            moveFile(files[0], output_file);
+            std::filesystem::resize_file(output_file, index.data_bytes);
+            finishOutput(output_file, index);
+            return;
+        }
+    }
+
+    // 打开输出文件，归并出的块交给I/O线程池异步写出；中间文件与run格式相同，最终输出只有原始记录。
+    // 输出不会超过各输入文件之和，按此预留空间
+    RunWriter<T> output(output_file, pool(Stage::Write), formatFor(output_file), totalFileBytes(files));
+    size_t copied = 0;
+    for (const auto& group : overlapGroups(files)) {
+        if (group.size() == 1) {
+            output.appendRun(group[0]);
+            copied++;
+            copied_runs_++;
+            continue;
+        }
+
+        // 为每个输入文件设置缓冲区最大元素数，最小为1防止缓冲区为0；
+        // 每个输入流同时持有正在归并的块和后台预读的块，因此再除以2
+        MergeCursor<T, Compare, ReduceOp> cursor(group, pool(Stage::Read), mergeBlockElements(group.size()), compare_,
+                                                 reducing());
+        std::vector<T> block;
+        while (cursor.next(block)) {
+            output.write(block);
+        }
+
+        if (reducing()) {
+            reduce_input_ += cursor.consumedRecords();
+            reduce_output_ += cursor.emittedRecords();
+        }
+    }
+    output.close();
+    finishOutput(output_file, output.index());
+
+    if (copied > 1) {
+        std::cout << "键范围不重叠的run直接复制: " << copied << "/" << files.size() << std::endl;
+    }
+}
+
+template<typename T, typename Compare, typename Combiner>
+Task<void> ExternalMergeSorter<T, Compare, Combiner>::mergeFilesAsync(std::vector<std::string> files, std::string output_file) {
+    if (files.empty()) {
+        co_return;
+    }
+
+    // 与mergeFiles相同，只是补充输入块、写出块和复制run时挂起协程，由I/O线程完成后在计算线程池上恢复
+    ThreadPool& executor = pool(Stage::Merge);
+    RunWriter<T> output(output_file, pool(Stage::Write), formatFor(output_file), totalFileBytes(files));
+    for (const auto& group : overlapGroups(files)) {
+        if (group.size() == 1) {
+            co_await output.appendRunAsync(group[0], executor);
+            copied_runs_++;
+            continue;
+        }
+
+        MergeCursor<T, Compare, ReduceOp> cursor(group, pool(Stage::Read), mergeBlockElements(group.size()), compare_,
+                                                 reducing());
+        std::vector<T> block;
+        while (co_await cursor.nextAsync(block, executor)) {
+            co_await output.writeAsync(block, executor);
+        }
+
+        if (reducing()) {
+            reduce_input_ += cursor.consumedRecords();
+            reduce_output_ += cursor.emittedRecords();
+        }
+    }
+    co_await output.closeAsync(executor);
+}
+
+#endif // EXTERNAL_MERGE_SORT_H
@@ -0,0 +1,22 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <string>
+#include <cstdint>
+
+// 把source中[offset, offset + bytes)的字节追加到target末尾。
+// target为空且从source开头复制时先尝试FICLONE（reflink），只共享数据块而不复制；
+// 否则用copy_file_range在内核中复制，数据不经过用户态；跨文件系统或内核不支持时退回到read/write
+void appendFileRange(const std::string& source, uint64_t offset, uint64_t bytes, const std::string& target);
+
+// 把source移动为target（已存在则覆盖）：同一文件系统内rename，否则按appendFileRange复制后删除source
+void moveFile(const std::string& source, const std::string& target);
+
+// 为path预留bytes字节的磁盘空间（fallocate，不改变文件大小），减少碎片和写入时的extent分配停顿；
+// 文件系统不支持时忽略
+void preallocateFile(const std::string& path, uint64_t bytes);
+
+// 释放path末尾之后多预留的空间，预留量是估计的上界时在写完后调用
+void trimPreallocation(const std::string& path);
+
+#endif // FILE_COPY_H
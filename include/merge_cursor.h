@@ -0,0 +1,258 @@
+#ifndef MERGE_CURSOR_H
+#define MERGE_CURSOR_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include "thread_pool.h"
+#include "block_io.h"
+#include "coro_task.h"
+#include "run_codec.h"
+#include "record_key.h"
+
+// run文件中从第first个记录开始的count个记录
+struct RunSlice {
+    std::string path;
+    uint64_t first = 0;
+    uint64_t count = UINT64_MAX;
+};
+
+// 多路归并游标：对若干已排序的run文件做k路归并，由调用方按块拉取结果。
+// 每个输入流由I/O线程池在后台预读；归并整个run时某个run读完后立即删除，提前close时删除剩余的run。
+// 协程中用nextAsync拉取，等待预读时挂起而不阻塞计算线程；各输入流的第一个块在第一次拉取时读入。
+// reduce为true时按Compare等价的记录用Combiner合并成一条再输出（KeepFirst即去重）
+template<typename T, typename Compare, typename Combiner = KeepFirst>
+class MergeCursor {
+public:
+    // run的格式由文件末尾的索引确定（见run_codec.h）
+    MergeCursor(const std::vector<std::string>& files, ThreadPool& io_pool, size_t block_elements,
+                Compare compare = Compare(), bool reduce = false)
+        : MergeCursor(wholeRuns(files), true, io_pool, block_elements, compare, reduce) {}
+
+    // 归并若干原始格式run的片段，不删除run文件，多个游标可以分别归并同一组run的不同片段
+    MergeCursor(const std::vector<RunSlice>& slices, ThreadPool& io_pool, size_t block_elements,
+                Compare compare = Compare(), bool reduce = false)
+        : MergeCursor(slices, false, io_pool, block_elements, compare, reduce) {}
+
+    ~MergeCursor() {
+        close();
+    }
+
+    MergeCursor(MergeCursor&&) = default;
+    MergeCursor(const MergeCursor&) = delete;
+    MergeCursor& operator=(const MergeCursor&) = delete;
+
+    // 取出下一批按Compare排好序的记录，block被替换为最多block_elements个记录；全部取完时返回false
+    bool next(std::vector<T>& block) {
+        block.clear();
+        if (!started_) {
+            // 初始化堆，从每个文件读取第一个元素
+            started_ = true;
+            for (size_t index = 0; index < slices_.size(); ++index) {
+                while (!pushBuffered(index)) {
+                    refilled(index, inputs_[index]->read(input_buffers_[index]));
+                }
+            }
+        }
+        while (block.size() < block_elements_ && !heap_.empty()) {
+            size_t index = emitTop(block);
+            while (!replaceTop(index)) {   // 从相同文件流中读取下一个元素，当前块用完时取出已预读好的下一个块
+                refilled(index, inputs_[index]->read(input_buffers_[index]));
+            }
+        }
+        return finishBlock(block);
+    }
+
+    // next的协程版本：输入流需要读入下一个块而预读尚未完成时挂起，读完后在executor上恢复
+    Task<bool> nextAsync(std::vector<T>& block, ThreadPool& executor) {
+        block.clear();
+        if (!started_) {
+            started_ = true;
+            for (size_t index = 0; index < slices_.size(); ++index) {
+                while (!pushBuffered(index)) {
+                    bool read = co_await inputs_[index]->readAsync(input_buffers_[index], executor);
+                    refilled(index, read);
+                }
+            }
+        }
+        while (block.size() < block_elements_ && !heap_.empty()) {
+            size_t index = emitTop(block);
+            while (!replaceTop(index)) {
+                bool read = co_await inputs_[index]->readAsync(input_buffers_[index], executor);
+                refilled(index, read);
+            }
+        }
+        co_return finishBlock(block);
+    }
+
+    // 已从各run取出的记录数和已输出的记录数，二者之差为合并掉的记录
+    uint64_t consumedRecords() const { return consumed_; }
+    uint64_t emittedRecords() const { return emitted_; }
+
+    // 提前结束归并：关闭所有输入流并删除尚未读完的run
+    void close() {
+        for (size_t i = 0; i < inputs_.size(); ++i) {
+            if (inputs_[i]) {
+                release(i);
+            }
+        }
+        heap_.clear();
+        pending_.reset();
+    }
+
+private:
+    MergeCursor(const std::vector<RunSlice>& slices, bool remove_runs, ThreadPool& io_pool, size_t block_elements,
+                Compare compare, bool reduce)
+        : slices_(slices), remove_runs_(remove_runs), block_elements_(std::max<size_t>(block_elements, 1)),
+          compare_(compare), reduce_(reduce), inputs_(slices.size()), input_buffers_(slices.size()),
+          buffer_positions_(slices.size(), 0) {
+        heap_.reserve(slices_.size());
+        for (size_t i = 0; i < slices_.size(); ++i) {
+            inputs_[i] = std::make_unique<RunReader<T>>(slices_[i].path, io_pool, block_elements_, slices_[i].first,
+                                                        slices_[i].count);
+        }
+    }
+
+    static std::vector<RunSlice> wholeRuns(const std::vector<std::string>& files) {
+        std::vector<RunSlice> slices;
+        for (const auto& file : files) {
+            slices.push_back({file});
+        }
+        return slices;
+    }
+
+    // 关闭一个输入流，归并整个run时同时删除中间顺序文件
+    void release(size_t index) {
+        inputs_[index]->close();
+        inputs_[index].reset();
+        if (remove_runs_) {
+            std::filesystem::remove(slices_[index].path);
+        }
+    }
+
+    // 使用最小堆进行k路归并，堆顶为按Compare排在最前的元素
+    struct Element {
+        T value;
+        size_t stream_index;
+    };
+
+    // 取出堆顶记录放入block（合并模式下先与暂存的记录合并），返回它所在的输入流。
+    // 堆顶暂不移除，由replaceTop换成同一输入流的下一个元素
+    size_t emitTop(std::vector<T>& block) {
+        const Element& elem = heap_.front();
+        consumed_++;
+
+        if (!reduce_) {
+            block.push_back(elem.value);
+            emitted_++;
+        } else if (pending_ && !compare_(*pending_, elem.value)) {
+            // 输出有序，与暂存的记录等价则合并进去
+            combine_(*pending_, elem.value);
+        } else {
+            // 遇到新的键，暂存的记录已合并完整，可以输出
+            if (pending_) {
+                block.push_back(*pending_);
+                emitted_++;
+            }
+            pending_ = elem.value;
+        }
+        return elem.stream_index;
+    }
+
+    // 所有run都已读完时输出最后暂存的记录，返回block是否非空
+    bool finishBlock(std::vector<T>& block) {
+        if (heap_.empty() && pending_ && block.size() < block_elements_) {
+            block.push_back(*pending_);
+            emitted_++;
+            pending_.reset();
+        }
+        return !block.empty();
+    }
+
+    // 开始归并时把指定输入流的第一个元素放入堆中；当前块已用完而输入流尚未读完时返回false，由调用方读入下一个块
+    bool pushBuffered(size_t index) {
+        if (buffer_positions_[index] < input_buffers_[index].size()) {
+            heap_.push_back({input_buffers_[index][buffer_positions_[index]++], index});
+            siftUp(heap_.size() - 1);
+            return true;
+        }
+        return !inputs_[index];
+    }
+
+    // 用堆顶所在输入流（index）的下一个元素替换堆顶并下沉，输入流已读完时移除堆顶。
+    // 替换只需一次下沉，比先弹出再压入少一半的调整；当前块已用完而输入流尚未读完时返回false，由调用方读入下一个块
+    bool replaceTop(size_t index) {
+        if (buffer_positions_[index] < input_buffers_[index].size()) {
+            heap_.front().value = input_buffers_[index][buffer_positions_[index]++];
+        } else if (!inputs_[index]) {
+            heap_.front() = heap_.back();
+            heap_.pop_back();
+            if (heap_.empty()) {
+                return true;
+            }
+        } else {
+            return false;
+        }
+        siftDown();
+        return true;
+    }
+
+    void siftUp(size_t hole) {
+        Element elem = heap_[hole];
+        while (hole > 0) {
+            size_t parent = (hole - 1) / 2;
+            if (!compare_(elem.value, heap_[parent].value)) {
+                break;
+            }
+            heap_[hole] = heap_[parent];
+            hole = parent;
+        }
+        heap_[hole] = elem;
+    }
+
+    // 堆顶元素下沉到不排在任何子节点之后的位置
+    void siftDown() {
+        Element elem = heap_.front();
+        const size_t size = heap_.size();
+        size_t hole = 0;
+        for (size_t child = 1; child < size; child = 2 * hole + 1) {
+            if (child + 1 < size && compare_(heap_[child + 1].value, heap_[child].value)) {
+                ++child;
+            }
+            if (!compare_(heap_[child].value, elem.value)) {
+                break;
+            }
+            heap_[hole] = heap_[child];
+            hole = child;
+        }
+        heap_[hole] = elem;
+    }
+
+    // 读入下一个块之后调用，read为读取结果：文件已读完时关闭流
+    void refilled(size_t index, bool read) {
+        buffer_positions_[index] = 0;
+        if (!read) {
+            release(index);
+        }
+    }
+
+    std::vector<RunSlice> slices_;
+    bool remove_runs_;
+    size_t block_elements_;
+    Compare compare_;
+    Combiner combine_;
+    bool reduce_;
+    bool started_ = false;       // 是否已从各输入流读入第一个元素
+    std::optional<T> pending_;   // 合并模式下暂存的记录，后续等价记录继续合并进来
+    uint64_t consumed_ = 0;
+    uint64_t emitted_ = 0;
+    std::vector<std::unique_ptr<RunReader<T>>> inputs_;
+    std::vector<std::vector<T>> input_buffers_;
+    std::vector<size_t> buffer_positions_;
+    std::vector<Element> heap_;   // 按Compare排序的小顶堆，堆顶为下一个输出的记录
+};
+
+#endif // MERGE_CURSOR_H
@@ -0,0 +1,183 @@
+#ifndef OUTPUT_INDEX_H
+#define OUTPUT_INDEX_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include "run_codec.h"
+
+// 排好序的输出文件的旁路索引（输出文件名 + ".idx"），两级结构：
+// [文件头，占一页][叶子页 × n][顶层条目]。叶子层是数据中每个块（约4096个记录）第一个记录的键和记录下标，
+// 按4KB页存放；顶层是每个叶子页的第一个条目，打开时整个读入内存。
+// 一次查询在内存中二分顶层，读一个叶子页定位到数据块，再读这一个数据块
+struct OutputIndexHeader {
+    uint32_t magic;
+    uint32_t record_size;        // sizeof(T)，打开时校验
+    uint64_t count;              // 数据文件中的记录数
+    uint64_t leaf_entries;       // 叶子条目数
+    uint64_t entries_per_page;   // 每个叶子页的条目数
+    uint64_t page_bytes;         // 叶子页大小
+};
+
+template<typename T>
+struct OutputIndexEntry {
+    T key;
+    uint64_t record;
+};
+
+constexpr uint32_t kOutputIndexMagic = 0x58444953;   // "SIDX"
+constexpr size_t kOutputIndexPageBytes = 4096;
+
+inline std::string outputIndexPath(const std::string& data_path) {
+    return data_path + ".idx";
+}
+
+// 用写出数据时收集的索引（RunWriter::index()）生成data_path的旁路索引，不需要再读一遍数据
+template<typename T>
+void writeOutputIndex(const std::string& data_path, const RunIndex<T>& index) {
+    using Entry = OutputIndexEntry<T>;
+    const uint64_t per_page = std::max<uint64_t>(kOutputIndexPageBytes / sizeof(Entry), 1);
+    const uint64_t page_bytes = (per_page * sizeof(Entry) + kOutputIndexPageBytes - 1) / kOutputIndexPageBytes *
+                                kOutputIndexPageBytes;
+    OutputIndexHeader header{kOutputIndexMagic, static_cast<uint32_t>(sizeof(T)), index.count,
+                             index.fence_keys.size(), per_page, page_bytes};
+
+    const std::string path = outputIndexPath(data_path);
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        throw std::runtime_error("无法创建索引文件: " + path);
+    }
+
+    std::vector<char> page(std::max<uint64_t>(page_bytes, sizeof(header)), 0);
+    std::memcpy(page.data(), &header, sizeof(header));
+    output.write(page.data(), page_bytes);
+
+    std::vector<Entry> top;
+    for (uint64_t begin = 0; begin < header.leaf_entries; begin += per_page) {
+        uint64_t n = std::min(per_page, header.leaf_entries - begin);
+        std::fill(page.begin(), page.end(), 0);
+        for (uint64_t i = 0; i < n; ++i) {
+            Entry entry{index.fence_keys[begin + i], index.fence_records[begin + i]};
+            std::memcpy(page.data() + i * sizeof(Entry), &entry, sizeof(Entry));
+        }
+        output.write(page.data(), page_bytes);
+        top.push_back({index.fence_keys[begin], index.fence_records[begin]});
+    }
+    output.write(reinterpret_cast<const char*>(top.data()), top.size() * sizeof(Entry));
+    if (!output) {
+        throw std::runtime_error("写入索引文件失败: " + path);
+    }
+}
+
+// 按旁路索引查询排好序的定长记录文件。Compare须与排序时的比较器一致；对象不是线程安全的，每个线程各开一个
+template<typename T, typename Compare = std::less<T>>
+class SortedFileReader {
+public:
+    explicit SortedFileReader(const std::string& data_path, Compare compare = Compare())
+        : compare_(compare), data_(data_path, std::ios::binary), index_(outputIndexPath(data_path), std::ios::binary) {
+        if (!data_.is_open() || !index_.is_open()) {
+            throw std::runtime_error("无法打开排序结果或其索引: " + data_path);
+        }
+        index_.read(reinterpret_cast<char*>(&header_), sizeof(header_));
+        if (!index_ || header_.magic != kOutputIndexMagic || header_.record_size != sizeof(T)) {
+            throw std::runtime_error("索引文件格式不正确: " + outputIndexPath(data_path));
+        }
+        data_.seekg(0, std::ios::end);
+        if (static_cast<uint64_t>(data_.tellg()) != header_.count * sizeof(T)) {
+            throw std::runtime_error("索引与数据文件不一致: " + data_path);
+        }
+
+        const uint64_t pages = (header_.leaf_entries + header_.entries_per_page - 1) / header_.entries_per_page;
+        top_.resize(pages);
+        index_.seekg(static_cast<std::streamoff>((1 + pages) * header_.page_bytes));
+        index_.read(reinterpret_cast<char*>(top_.data()), pages * sizeof(Entry));
+        if (!index_) {
+            throw std::runtime_error("读取索引顶层失败: " + data_path);
+        }
+    }
+
+    uint64_t size() const { return header_.count; }
+
+    // 第i个记录
+    T at(uint64_t i) {
+        if (i >= header_.count) {
+            throw std::out_of_range("记录下标越界: " + std::to_string(i));
+        }
+        return readBlock(i, i + 1)[0];
+    }
+
+    // 第一个不排在key之前的记录下标
+    uint64_t lower_bound(const T& key) {
+        return search([&](const T& record) { return !compare_(record, key); });
+    }
+
+    // 第一个排在key之后的记录下标
+    uint64_t upper_bound(const T& key) {
+        return search([&](const T& record) { return compare_(key, record); });
+    }
+
+    // 键在[lo, hi)内的全部记录
+    std::vector<T> range(const T& lo, const T& hi) {
+        uint64_t first = lower_bound(lo);
+        uint64_t last = std::max(first, lower_bound(hi));
+        return readBlock(first, last);
+    }
+
+private:
+    using Entry = OutputIndexEntry<T>;
+
+    // 返回第一个满足after的记录下标，after在有序数据上先为false后为true
+    template<typename Pred>
+    uint64_t search(Pred after) {
+        // 顶层在内存中：找到最后一个首键不满足after的叶子页，第0页的首键即第一个记录
+        size_t page = std::partition_point(top_.begin(), top_.end(),
+                                           [&](const Entry& entry) { return !after(entry.key); }) - top_.begin();
+        if (page == 0) {
+            return 0;
+        }
+        page--;
+
+        // 读一个叶子页，找到最后一个首键不满足after的数据块
+        const uint64_t first_entry = page * header_.entries_per_page;
+        std::vector<Entry> entries(std::min(header_.entries_per_page, header_.leaf_entries - first_entry));
+        index_.seekg(static_cast<std::streamoff>((1 + page) * header_.page_bytes));
+        index_.read(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(Entry));
+        if (!index_) {
+            throw std::runtime_error("读取索引页失败");
+        }
+        size_t block = std::partition_point(entries.begin(), entries.end(),
+                                            [&](const Entry& entry) { return !after(entry.key); }) - entries.begin() - 1;
+
+        // 读这一个数据块，在块内二分；块内都不满足时答案为下一个块的起点
+        uint64_t first = entries[block].record;
+        uint64_t last = block + 1 < entries.size() ? entries[block + 1].record
+                        : page + 1 < top_.size()   ? top_[page + 1].record
+                                                   : header_.count;
+        std::vector<T> records = readBlock(first, last);
+        return first + (std::partition_point(records.begin(), records.end(),
+                                             [&](const T& record) { return !after(record); }) - records.begin());
+    }
+
+    std::vector<T> readBlock(uint64_t first, uint64_t last) {
+        std::vector<T> records(last - first);
+        data_.seekg(static_cast<std::streamoff>(first * sizeof(T)));
+        data_.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(T));
+        if (!data_) {
+            throw std::runtime_error("读取排序结果失败，下标: " + std::to_string(first));
+        }
+        return records;
+    }
+
+    Compare compare_;
+    std::ifstream data_;
+    std::ifstream index_;
+    OutputIndexHeader header_{};
+    std::vector<Entry> top_;
+};
+
+#endif // OUTPUT_INDEX_H
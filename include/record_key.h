@@ -0,0 +1,153 @@
+#ifndef RECORD_KEY_H
+#define RECORD_KEY_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// 从记录中取出成员作为排序键，例如 MemberKey<&KeyValue::key>
+template<auto Member>
+struct MemberKey {
+    template<typename Record>
+    const auto& operator()(const Record& record) const {
+        return record.*Member;
+    }
+};
+
+// 规范化键前缀：把键映射为uint64_t，使前缀的无符号比较顺序与键的升序一致。
+// 键较宽时只保留高位，前缀相等的两个键仍需完整比较
+template<typename K>
+uint64_t normalizedKeyPrefix(const K& key) {
+    static_assert(std::is_arithmetic_v<K>, "只支持算术类型的键");
+    if constexpr (std::is_floating_point_v<K>) {
+        // IEEE 754：负数取反全部位，非负数只翻转符号位
+        uint64_t bits;
+        if constexpr (sizeof(K) == sizeof(uint64_t)) {
+            std::memcpy(&bits, &key, sizeof(bits));
+        } else {
+            double widened = key;
+            std::memcpy(&bits, &widened, sizeof(bits));
+        }
+        return (bits >> 63) ? ~bits : (bits | (uint64_t(1) << 63));
+    } else if constexpr (std::is_signed_v<K>) {
+        // 有符号整数：翻转符号位后按无符号比较
+        using U = std::make_unsigned_t<K>;
+        U flipped = static_cast<U>(key) ^ (U(1) << (sizeof(K) * 8 - 1));
+        if constexpr (sizeof(K) > sizeof(uint64_t)) {
+            return static_cast<uint64_t>(flipped >> (sizeof(K) * 8 - 64));
+        } else {
+            return flipped;
+        }
+    } else {
+        if constexpr (sizeof(K) > sizeof(uint64_t)) {
+            return static_cast<uint64_t>(key >> (sizeof(K) * 8 - 64));
+        } else {
+            return key;
+        }
+    }
+}
+
+template<typename K>
+constexpr bool kHasNormalizedPrefix = std::is_arithmetic_v<K>;
+
+// __int128不满足std::is_arithmetic，单独处理
+template<>
+inline uint64_t normalizedKeyPrefix<__int128>(const __int128& key) {
+    return static_cast<uint64_t>(key >> 64) ^ (uint64_t(1) << 63);
+}
+
+template<>
+inline uint64_t normalizedKeyPrefix<unsigned __int128>(const unsigned __int128& key) {
+    return static_cast<uint64_t>(key >> 64);
+}
+
+template<>
+constexpr bool kHasNormalizedPrefix<__int128> = true;
+template<>
+constexpr bool kHasNormalizedPrefix<unsigned __int128> = true;
+
+// 比较器对键K的顺序：std::less为升序（1），std::greater为降序（-1），其他比较器未知（0）
+template<typename KeyLess, typename K>
+constexpr int kKeyOrder =
+    (std::is_same_v<KeyLess, std::less<>> || std::is_same_v<KeyLess, std::less<K>>) ? 1 :
+    (std::is_same_v<KeyLess, std::greater<>> || std::is_same_v<KeyLess, std::greater<K>>) ? -1 : 0;
+
+// 降序时前缀按位取反，无符号比较的顺序随之反转
+template<int Order, typename K>
+uint64_t orderedKeyPrefix(const K& key) {
+    return Order > 0 ? normalizedKeyPrefix(key) : ~normalizedKeyPrefix(key);
+}
+
+// 先用KeyOf提取键再用KeyLess比较，全部为无状态类型，编译期内联。
+// 键为算术类型且按升序或降序比较时同时提供prefix()，供宽记录的前缀排序使用
+template<typename KeyOf, typename KeyLess = std::less<>>
+struct KeyCompare {
+    template<typename Record>
+    bool operator()(const Record& a, const Record& b) const {
+        return KeyLess()(KeyOf()(a), KeyOf()(b));
+    }
+
+    template<typename Record,
+             typename Key = std::decay_t<decltype(KeyOf()(std::declval<const Record&>()))>,
+             typename = std::enable_if_t<kHasNormalizedPrefix<Key> && kKeyOrder<KeyLess, Key> != 0>>
+    uint64_t prefix(const Record& record) const {
+        return orderedKeyPrefix<kKeyOrder<KeyLess, Key>>(KeyOf()(record));
+    }
+};
+
+// 记录类型T在比较器Compare下的规范化键前缀。比较器提供 uint64_t prefix(const T&) 时可用，
+// 要求 comp(a, b) 成立时 prefix(a) <= prefix(b)
+template<typename T, typename Compare, typename = void>
+struct KeyPrefixTraits {
+    static constexpr bool available = false;
+};
+
+template<typename T, typename Compare>
+struct KeyPrefixTraits<T, Compare,
+                       std::void_t<decltype(std::declval<const Compare&>().prefix(std::declval<const T&>()))>> {
+    static constexpr bool available = true;
+
+    static uint64_t prefix(const Compare& compare, const T& record) {
+        return compare.prefix(record);
+    }
+};
+
+// 记录本身就是算术类型且按升序或降序排序
+template<typename T>
+struct KeyPrefixTraits<T, std::less<T>, std::enable_if_t<kHasNormalizedPrefix<T>>> {
+    static constexpr bool available = true;
+
+    static uint64_t prefix(const std::less<T>&, const T& record) {
+        return orderedKeyPrefix<1>(record);
+    }
+};
+
+template<typename T>
+struct KeyPrefixTraits<T, std::greater<T>, std::enable_if_t<kHasNormalizedPrefix<T>>> {
+    static constexpr bool available = true;
+
+    static uint64_t prefix(const std::greater<T>&, const T& record) {
+        return orderedKeyPrefix<-1>(record);
+    }
+};
+
+// 等价记录的合并操作：把next合并进acc，用于去重和聚合排序。
+// 只保留第一条，即去重
+struct KeepFirst {
+    template<typename Record>
+    void operator()(Record&, const Record&) const {}
+};
+
+// 累加记录中的某个成员，例如 SumMember<&KeyCount::count> 统计每个键的出现次数，
+// SumMember<&KeyValue::value> 对每个键的值求和
+template<auto Member>
+struct SumMember {
+    template<typename Record>
+    void operator()(Record& acc, const Record& next) const {
+        acc.*Member += next.*Member;
+    }
+};
+
+#endif // RECORD_KEY_H
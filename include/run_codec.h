@@ -0,0 +1,640 @@
+#ifndef RUN_CODEC_H
+#define RUN_CODEC_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <utility>
+#include "thread_pool.h"
+#include "block_io.h"
+#include "coro_task.h"
+#include "text_codec.h"
+
+// 可以使用压缩run格式的记录类型
+template<typename T>
+constexpr bool kCompressibleRun = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+// 有序整数run的差分+变长整数（varint）压缩格式。数据部分由若干帧组成，每帧为
+// [uint32 负载字节数][uint32 记录数][首个记录原样][其余记录与前一个记录之差，zigzag后按varint编码]。
+// 差值在无符号算术下计算并做zigzag变换，任何比较器顺序（包括降序）都能正确往返，升序或降序时压缩效果最好
+template<typename T>
+struct DeltaVarintCodec {
+    static_assert(kCompressibleRun<T>, "差分压缩只支持整数记录");
+
+    using U = std::make_unsigned_t<T>;
+    using S = std::make_signed_t<T>;
+
+    static constexpr size_t kFrameHeaderBytes = 2 * sizeof(uint32_t);
+    // 每帧的记录数，帧越小解码时需要暂存的字节越少
+    static constexpr size_t kFrameRecords = 4096;
+
+    // 把count个记录编码成若干帧追加到out
+    static void encode(const T* data, size_t count, std::vector<char>& out) {
+        for (size_t begin = 0; begin < count; begin += kFrameRecords) {
+            size_t n = std::min(kFrameRecords, count - begin);
+            size_t header = out.size();
+            out.resize(header + kFrameHeaderBytes + sizeof(T) + n * kMaxVarintBytes);
+
+            char* cursor = out.data() + header + kFrameHeaderBytes;
+            std::memcpy(cursor, &data[begin], sizeof(T));
+            cursor += sizeof(T);
+            for (size_t i = begin + 1; i < begin + n; ++i) {
+                cursor = putVarint(cursor, zigzag(static_cast<U>(static_cast<U>(data[i]) - static_cast<U>(data[i - 1]))));
+            }
+
+            uint32_t frame[2] = {static_cast<uint32_t>(cursor - (out.data() + header) - kFrameHeaderBytes),
+                                 static_cast<uint32_t>(n)};
+            std::memcpy(out.data() + header, frame, sizeof(frame));
+            out.resize(cursor - out.data());
+        }
+    }
+
+    // 从一帧负载[payload, end)中接着解码count个记录追加到out，一帧可以分多次解码。
+    // first为true表示从帧的首个记录开始；value为上一次解码出的最后一个记录，返回时更新。返回下一个未解码的字节
+    static const char* decodeRecords(const char* payload, const char* end, bool first, T& value, size_t count,
+                                     std::vector<T>& out) {
+        if (count == 0) {
+            return payload;
+        }
+        if (first) {
+            if (static_cast<size_t>(end - payload) < sizeof(T)) {
+                throw std::runtime_error("压缩帧损坏");
+            }
+            std::memcpy(&value, payload, sizeof(T));
+            payload += sizeof(T);
+            out.push_back(value);
+            --count;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            U delta;
+            payload = getVarint(payload, end, delta);
+            value = static_cast<T>(static_cast<U>(value) + unzigzag(delta));
+            out.push_back(value);
+        }
+        return payload;
+    }
+
+private:
+    static constexpr size_t kMaxVarintBytes = (sizeof(U) * 8 + 6) / 7;
+
+    static U zigzag(U delta) {
+        return static_cast<U>(delta << 1) ^ static_cast<U>(static_cast<S>(delta) >> (sizeof(U) * 8 - 1));
+    }
+
+    static U unzigzag(U value) {
+        return static_cast<U>(value >> 1) ^ static_cast<U>(0 - (value & 1));
+    }
+
+    static char* putVarint(char* out, U value) {
+        while (value >= 0x80) {
+            *out++ = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        *out++ = static_cast<char>(value);
+        return out;
+    }
+
+    static const char* getVarint(const char* in, const char* end, U& value) {
+        value = 0;
+        for (unsigned shift = 0; in < end && shift < sizeof(U) * 8; shift += 7) {
+            unsigned char byte = static_cast<unsigned char>(*in++);
+            value |= static_cast<U>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return in;
+            }
+        }
+        throw std::runtime_error("压缩帧损坏");
+    }
+};
+
+// 文件格式：输入文件和最终输出只有原始记录；临时run在数据之后附带索引尾部（见RunIndex）
+enum class RunFormat {
+    Plain,        // 只有原始记录，没有索引
+    Raw,          // 原始记录 + 索引
+    Compressed,   // 差分压缩帧 + 索引，只支持整数记录
+    Text          // 每行一个十进制整数，没有索引，只用于最终输出
+};
+
+// run文件的最后一部分，固定大小，由此定位索引的其余部分
+struct RunTrailer {
+    uint64_t count;        // 记录数
+    uint64_t data_bytes;   // 数据部分的字节数，索引从这里开始
+    uint64_t fences;       // fence个数
+    uint32_t compressed;   // 数据是否为压缩帧
+    uint32_t magic;
+};
+
+// run的索引，写在run文件末尾：
+// [数据][fence键 × n][fence记录下标 × n][fence字节偏移 × n][最小记录][最大记录][RunTrailer]。
+// fence是每个块的第一个记录（原始格式每kFenceRecords个记录一个，压缩格式每帧一个），
+// 只读尾部就能得到记录数和键范围，并按键定位到块而无需扫描数据
+template<typename T>
+struct RunIndex {
+    static constexpr size_t kFenceRecords = 4096;
+    static constexpr uint32_t kMagic = 0x58444952;   // "RIDX"
+
+    uint64_t count = 0;
+    uint64_t data_bytes = 0;
+    bool compressed = false;
+    T min{};   // count为0时无意义
+    T max{};
+    std::vector<T> fence_keys;
+    std::vector<uint64_t> fence_records;
+    std::vector<uint64_t> fence_offsets;
+
+    void addFence(const T& key, uint64_t record, uint64_t offset) {
+        fence_keys.push_back(key);
+        fence_records.push_back(record);
+        fence_offsets.push_back(offset);
+    }
+
+    // 把索引追加到数据部分已写完的run文件末尾
+    void append(const std::string& path) const {
+        std::ofstream output(path, std::ios::binary | std::ios::app);
+        RunTrailer trailer{count, data_bytes, fence_keys.size(), compressed ? 1u : 0u, kMagic};
+        output.write(reinterpret_cast<const char*>(fence_keys.data()), fence_keys.size() * sizeof(T));
+        output.write(reinterpret_cast<const char*>(fence_records.data()), fence_records.size() * sizeof(uint64_t));
+        output.write(reinterpret_cast<const char*>(fence_offsets.data()), fence_offsets.size() * sizeof(uint64_t));
+        output.write(reinterpret_cast<const char*>(&min), sizeof(T));
+        output.write(reinterpret_cast<const char*>(&max), sizeof(T));
+        output.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        if (!output) {
+            throw std::runtime_error("写入run索引失败: " + path);
+        }
+    }
+
+    // 读取run文件末尾的索引
+    static RunIndex load(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input.is_open()) {
+            throw std::runtime_error("无法打开文件: " + path);
+        }
+        input.seekg(0, std::ios::end);
+        const uint64_t size = static_cast<uint64_t>(input.tellg());
+
+        RunTrailer trailer{};
+        if (size >= sizeof(trailer)) {
+            input.seekg(static_cast<std::streamoff>(size - sizeof(trailer)));
+            input.read(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+        }
+        const uint64_t index_bytes = trailer.fences * (sizeof(T) + 2 * sizeof(uint64_t)) + 2 * sizeof(T) + sizeof(trailer);
+        if (!input || trailer.magic != kMagic || trailer.data_bytes + index_bytes != size) {
+            throw std::runtime_error("run文件缺少索引或已损坏: " + path);
+        }
+
+        RunIndex index;
+        index.count = trailer.count;
+        index.data_bytes = trailer.data_bytes;
+        index.compressed = trailer.compressed != 0;
+        index.fence_keys.resize(trailer.fences);
+        index.fence_records.resize(trailer.fences);
+        index.fence_offsets.resize(trailer.fences);
+        input.seekg(static_cast<std::streamoff>(trailer.data_bytes));
+        input.read(reinterpret_cast<char*>(index.fence_keys.data()), trailer.fences * sizeof(T));
+        input.read(reinterpret_cast<char*>(index.fence_records.data()), trailer.fences * sizeof(uint64_t));
+        input.read(reinterpret_cast<char*>(index.fence_offsets.data()), trailer.fences * sizeof(uint64_t));
+        input.read(reinterpret_cast<char*>(&index.min), sizeof(T));
+        input.read(reinterpret_cast<char*>(&index.max), sizeof(T));
+        if (!input) {
+            throw std::runtime_error("读取run索引失败: " + path);
+        }
+        return index;
+    }
+
+    // 按fence把第一个不排在key之前（upper为true时为第一个排在key之后）的记录下标限定在[first, last]内，
+    // 之后只需在这一个块内二分查找；key排在最小或最大记录之外时直接得到结果，不读数据
+    template<typename Compare>
+    std::pair<uint64_t, uint64_t> locate(const T& key, const Compare& compare, bool upper) const {
+        auto after = [&](const T& record) {
+            return upper ? compare(key, record) : !compare(record, key);
+        };
+        if (count == 0 || !after(max)) {
+            return {count, count};
+        }
+        size_t j = std::partition_point(fence_keys.begin(), fence_keys.end(),
+                                        [&](const T& fence) { return !after(fence); }) - fence_keys.begin();
+        uint64_t first = j > 0 ? fence_records[j - 1] : 0;
+        uint64_t last = j < fence_records.size() ? fence_records[j] : count;
+        return {first, last};
+    }
+};
+
+// 把原始格式的run截断到前count个记录，并重写其索引
+template<typename T>
+void truncateRun(const std::string& path, uint64_t count) {
+    RunIndex<T> index = RunIndex<T>::load(path);
+    if (index.compressed) {
+        throw std::runtime_error("压缩run不支持截断: " + path);
+    }
+    if (count >= index.count) {
+        return;
+    }
+
+    std::filesystem::resize_file(path, count * sizeof(T));
+    index.count = count;
+    index.data_bytes = count * sizeof(T);
+    size_t fences = std::lower_bound(index.fence_records.begin(), index.fence_records.end(), count) -
+                    index.fence_records.begin();
+    index.fence_keys.resize(fences);
+    index.fence_records.resize(fences);
+    index.fence_offsets.resize(fences);
+    if (count > 0) {
+        std::ifstream input(path, std::ios::binary);
+        input.seekg(static_cast<std::streamoff>((count - 1) * sizeof(T)));
+        input.read(reinterpret_cast<char*>(&index.max), sizeof(T));
+        if (!input) {
+            throw std::runtime_error("读取run记录失败: " + path);
+        }
+    }
+    index.append(path);
+}
+
+template<typename T>
+class RunReader;
+
+// run写入器：原始格式直接交给BlockWriter；压缩和文本格式在调用线程上编码，再把字节交给I/O线程池异步写出。
+// 写入时同时收集索引，Raw和Compressed格式关闭时追加到文件末尾；Plain格式的索引可在关闭后通过index()取得。
+// expected_bytes为数据部分大小的估计（通常是原始记录的字节数），用于预留磁盘空间
+template<typename T>
+class RunWriter {
+public:
+    RunWriter(const std::string& path, ThreadPool& io_pool, RunFormat format, uint64_t expected_bytes = 0)
+        : path_(path), io_pool_(io_pool), indexed_(format == RunFormat::Raw || format == RunFormat::Compressed),
+          text_(format == RunFormat::Text) {
+        if (format == RunFormat::Text) {
+            if constexpr (kTextRecord<T>) {
+                packed_ = std::make_unique<BlockWriter<char>>(path, io_pool, expected_bytes);
+            } else {
+                throw std::runtime_error("只有整数记录支持文本输出");
+            }
+        } else if (format == RunFormat::Compressed) {
+            if constexpr (kCompressibleRun<T>) {
+                packed_ = std::make_unique<BlockWriter<char>>(path, io_pool, expected_bytes);
+                index_.compressed = true;
+            } else {
+                throw std::runtime_error("只有整数记录支持压缩run");
+            }
+        } else {
+            raw_ = std::make_unique<BlockWriter<T>>(path, io_pool, expected_bytes);
+        }
+    }
+
+    // 写出一个块。原始格式下block被替换为空闲缓冲区，压缩和文本格式下block被清空（容量保留）
+    void write(std::vector<T>& block) {
+        if (raw_) {
+            collect(block);
+            raw_->write(block);
+            return;
+        }
+        encode(block);
+        packed_->write(bytes_);   // bytes_被替换为已清空的空闲缓冲区
+    }
+
+    // write的协程版本，上一个块尚未写完时挂起，写完后在executor上恢复
+    Task<void> writeAsync(std::vector<T>& block, ThreadPool& executor) {
+        if (raw_) {
+            collect(block);
+            co_await raw_->writeAsync(block, executor);
+            co_return;
+        }
+        encode(block);
+        co_await packed_->writeAsync(bytes_, executor);
+    }
+
+    // 把整个run追加到输出末尾，随后删除该run。数据格式相同时直接复制数据部分的字节（帧自带起始值，可以直接拼接），
+    // 否则逐块解码后写出；调用方保证run中的记录都不排在已写出的记录之前
+    void appendRun(const std::string& path) {
+        RunIndex<T> source = RunIndex<T>::load(path);
+        if (copyable(source)) {
+            mergeIndex(source);
+            if (raw_) {
+                raw_->append(path, 0, source.data_bytes);
+            } else {
+                packed_->append(path, 0, source.data_bytes);
+            }
+        } else {
+            RunReader<T> reader(path, io_pool_, kCopyBlockRecords);
+            std::vector<T> block;
+            while (reader.read(block)) {
+                write(block);
+            }
+            reader.close();
+        }
+        removeAfterCopy(path);
+    }
+
+    // appendRun的协程版本
+    Task<void> appendRunAsync(std::string path, ThreadPool& executor) {
+        RunIndex<T> source = RunIndex<T>::load(path);
+        if (copyable(source)) {
+            mergeIndex(source);
+            if (raw_) {
+                co_await raw_->appendAsync(path, 0, source.data_bytes, executor);
+            } else {
+                co_await packed_->appendAsync(path, 0, source.data_bytes, executor);
+            }
+        } else {
+            RunReader<T> reader(path, io_pool_, kCopyBlockRecords);
+            std::vector<T> block;
+            while (co_await reader.readAsync(block, executor)) {
+                co_await writeAsync(block, executor);
+            }
+            reader.close();
+        }
+        removeAfterCopy(path);
+    }
+
+    // 等待所有块写完、追加索引并关闭文件，原始格式下返回最后一个块的缓冲区
+    std::vector<T> close() {
+        std::vector<T> spare;
+        if (raw_) {
+            spare = raw_->close();
+        } else {
+            packed_->close();
+        }
+        appendIndex();
+        removeCopiedRuns();
+        return spare;
+    }
+
+    // close的协程版本，索引由I/O线程追加
+    Task<std::vector<T>> closeAsync(ThreadPool& executor) {
+        std::vector<T> spare;
+        if (raw_) {
+            spare = co_await raw_->closeAsync(executor);
+        } else {
+            co_await packed_->closeAsync(executor);
+        }
+        if (indexed_) {
+            AsyncResult<bool> appended = AsyncResult<bool>::run(io_pool_, [this] {
+                appendIndex();
+                return true;
+            });
+            co_await appended.resumeOn(executor);
+        } else {
+            appendIndex();
+        }
+        removeCopiedRuns();
+        co_return spare;
+    }
+
+    // 已写出数据的索引，count和data_bytes在关闭后有效
+    const RunIndex<T>& index() const { return index_; }
+
+private:
+    // 原始格式：记录键范围，每kFenceRecords个记录取一个fence
+    void collect(const std::vector<T>& block) {
+        if (block.empty()) {
+            return;
+        }
+        noteRange(block);
+        const uint64_t stride = RunIndex<T>::kFenceRecords;
+        for (uint64_t record = (records_ + stride - 1) / stride * stride; record < records_ + block.size();
+             record += stride) {
+            index_.addFence(block[record - records_], record, record * sizeof(T));
+        }
+        records_ += block.size();
+    }
+
+    // 把block逐帧编码为压缩格式的字节放入bytes_，每帧的第一个记录作为fence，block被清空（容量保留）；
+    // 文本格式格式化为文本行，不收集fence
+    void encode(std::vector<T>& block) {
+        if (text_) {
+            if constexpr (kTextRecord<T>) {
+                if (!block.empty()) {
+                    noteRange(block);
+                }
+                DecimalTextCodec<T>::format(block.data(), block.size(), bytes_);
+                records_ += block.size();
+                written_ += bytes_.size();
+                block.clear();
+            }
+            return;
+        }
+        if constexpr (kCompressibleRun<T>) {
+            using Codec = DeltaVarintCodec<T>;
+            if (!block.empty()) {
+                noteRange(block);
+            }
+            for (size_t begin = 0; begin < block.size(); begin += Codec::kFrameRecords) {
+                size_t n = std::min(Codec::kFrameRecords, block.size() - begin);
+                index_.addFence(block[begin], records_ + begin, written_ + bytes_.size());
+                Codec::encode(block.data() + begin, n, bytes_);
+            }
+            records_ += block.size();
+            written_ += bytes_.size();
+            block.clear();
+        }
+    }
+
+    // 逐块解码追加run时每块的记录数
+    static constexpr size_t kCopyBlockRecords = 1 << 16;
+
+    // 源run的数据能否直接拼接到输出的数据部分，文本输出总要逐块格式化
+    bool copyable(const RunIndex<T>& source) const {
+        return !text_ && source.compressed == (packed_ != nullptr);
+    }
+
+    // 复制数据部分之后，把源run的索引平移后并入输出的索引
+    void mergeIndex(const RunIndex<T>& source) {
+        if (source.count == 0) {
+            return;
+        }
+        if (records_ == 0) {
+            index_.min = source.min;
+        }
+        index_.max = source.max;
+        const uint64_t base_offset = raw_ ? records_ * sizeof(T) : written_;
+        for (size_t j = 0; j < source.fence_keys.size(); ++j) {
+            index_.addFence(source.fence_keys[j], records_ + source.fence_records[j],
+                            base_offset + source.fence_offsets[j]);
+        }
+        records_ += source.count;
+        if (packed_) {
+            written_ += source.data_bytes;
+        }
+    }
+
+    // 复制由I/O线程异步完成，源run在复制结束后才能删除，删除推迟到close时进行
+    void removeAfterCopy(const std::string& path) {
+        copied_runs_.push_back(path);
+    }
+
+    void removeCopiedRuns() {
+        for (const auto& path : copied_runs_) {
+            std::filesystem::remove(path);
+        }
+        copied_runs_.clear();
+    }
+
+    void noteRange(const std::vector<T>& block) {
+        if (records_ == 0) {
+            index_.min = block.front();
+        }
+        index_.max = block.back();
+    }
+
+    // 补全索引的记录数和数据字节数，需要时追加到文件末尾
+    void appendIndex() {
+        index_.count = records_;
+        index_.data_bytes = raw_ ? records_ * sizeof(T) : written_;
+        if (indexed_) {
+            index_.append(path_);
+        }
+    }
+
+    std::string path_;
+    ThreadPool& io_pool_;
+    bool indexed_;
+    bool text_;
+    RunIndex<T> index_;
+    uint64_t records_ = 0;   // 已写出的记录数
+    uint64_t written_ = 0;   // 压缩和文本格式已写出的字节数
+    std::unique_ptr<BlockWriter<T>> raw_;
+    std::unique_ptr<BlockWriter<char>> packed_;
+    std::vector<char> bytes_;
+    std::vector<std::string> copied_runs_;   // 已追加到输出、等待删除的run
+};
+
+// run读取器：先读取文件末尾的索引得到格式和数据范围。原始格式直接由BlockReader预读；
+// 压缩格式由BlockReader预读字节，在调用线程上解码，帧可能跨越多个读入的块
+template<typename T>
+class RunReader {
+public:
+    RunReader(const std::string& path, ThreadPool& io_pool, size_t block_elements,
+              uint64_t first = 0, uint64_t count = UINT64_MAX)
+        : path_(path), block_elements_(std::max<size_t>(block_elements, 1)), index_(RunIndex<T>::load(path)) {
+        if (!index_.compressed) {
+            first = std::min(first, index_.count);
+            raw_ = std::make_unique<BlockReader<T>>(path, io_pool, block_elements_, first,
+                                                    std::min(count, index_.count - first));
+            return;
+        }
+        if (first != 0 || count != UINT64_MAX) {
+            throw std::runtime_error("压缩run不支持按记录范围读取: " + path);
+        }
+        // 压缩后的字节数通常远小于原始大小，按原始块大小的一半预读
+        packed_ = std::make_unique<BlockReader<char>>(path, io_pool,
+                                                      std::max<size_t>(block_elements_ * sizeof(T) / 2, 4096), 0,
+                                                      index_.data_bytes);
+    }
+
+    const RunIndex<T>& index() const { return index_; }
+
+    // 取出下一批记录，文件读完时返回false且block为空
+    bool read(std::vector<T>& block) {
+        if (raw_) {
+            return raw_->read(block);
+        }
+        block.clear();
+        while (decodeFrames(block)) {
+            if (!appendChunk(packed_->read(chunk_))) {
+                break;
+            }
+        }
+        return !block.empty();
+    }
+
+    // read的协程版本：预读尚未完成时挂起当前协程，读完后在executor上恢复
+    Task<bool> readAsync(std::vector<T>& block, ThreadPool& executor) {
+        if (raw_) {
+            bool read = co_await raw_->readAsync(block, executor);
+            co_return read;
+        }
+        block.clear();
+        while (decodeFrames(block)) {
+            bool read = co_await packed_->readAsync(chunk_, executor);
+            if (!appendChunk(read)) {
+                break;
+            }
+        }
+        co_return !block.empty();
+    }
+
+    void close() {
+        if (raw_) {
+            raw_->close();
+        } else {
+            packed_->close();
+        }
+    }
+
+private:
+    // 解码已读入的完整帧直到block装满（最多block_elements_个记录，一帧可以分几次取出，帧内位置保留到下次）；
+    // 帧不完整时丢弃已解码的字节并返回true，表示需要再读入下一个块
+    bool decodeFrames(std::vector<T>& block) {
+        if constexpr (kCompressibleRun<T>) {
+            using Codec = DeltaVarintCodec<T>;
+            while (block.size() < block_elements_) {
+                if (frame_left_ > 0) {
+                    size_t n = std::min<size_t>(frame_left_, block_elements_ - block.size());
+                    const char* next = Codec::decodeRecords(pending_.data() + pending_pos_, pending_.data() + frame_end_,
+                                                            frame_first_, frame_value_, n, block);
+                    pending_pos_ = next - pending_.data();
+                    frame_left_ -= n;
+                    frame_first_ = false;
+                    if (frame_left_ == 0 && pending_pos_ != frame_end_) {
+                        throw std::runtime_error("压缩帧损坏: " + path_);
+                    }
+                    continue;
+                }
+
+                size_t available = pending_.size() - pending_pos_;
+                if (available >= Codec::kFrameHeaderBytes) {
+                    uint32_t frame[2];
+                    std::memcpy(frame, pending_.data() + pending_pos_, sizeof(frame));
+                    if (available >= Codec::kFrameHeaderBytes + frame[0]) {
+                        if (frame[1] == 0) {
+                            throw std::runtime_error("压缩帧损坏: " + path_);
+                        }
+                        pending_pos_ += Codec::kFrameHeaderBytes;
+                        frame_end_ = pending_pos_ + frame[0];
+                        frame_left_ = frame[1];
+                        frame_first_ = true;
+                        continue;
+                    }
+                }
+
+                pending_.erase(pending_.begin(), pending_.begin() + pending_pos_);
+                pending_pos_ = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 追加读入的字节块（chunk_），文件已读完时返回false
+    bool appendChunk(bool read) {
+        if (!read) {
+            if (!pending_.empty()) {
+                throw std::runtime_error("压缩run文件不完整: " + path_);
+            }
+            return false;
+        }
+        pending_.insert(pending_.end(), chunk_.begin(), chunk_.end());
+        return true;
+    }
+
+    std::string path_;
+    size_t block_elements_;
+    RunIndex<T> index_;
+    std::unique_ptr<BlockReader<T>> raw_;
+    std::unique_ptr<BlockReader<char>> packed_;
+    std::vector<char> chunk_;     // 从读取器取得的原始字节块
+    std::vector<char> pending_;   // 尚未解码的字节
+    size_t pending_pos_ = 0;
+    // 正在解码的帧：负载在pending_中的结束位置、剩余记录数、是否还未解码首个记录、上一个解码出的记录
+    size_t frame_end_ = 0;
+    size_t frame_left_ = 0;
+    bool frame_first_ = false;
+    T frame_value_{};
+};
+
+#endif // RUN_CODEC_H
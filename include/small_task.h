@@ -0,0 +1,171 @@
+#ifndef SMALL_TASK_H
+#define SMALL_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 小对象内存池：按64字节分级的空闲链表，每个线程有本地缓存，本地缓存过多或为空时与全局链表交换。
+// 每个块的头部记录分配它的线程：本线程分配的块释放到本地缓存，其他线程分配的块直接归还全局链表，
+// 因此空闲块不会滞留在只释放不分配的线程中；例如只有提交线程分配时，池中的块数达到同时存活的峰值后不再向系统申请内存。
+// 用于承载future/promise共享状态等生命周期短、大小固定的对象
+class BlockPool {
+public:
+    static constexpr size_t kGranularity = 64;    // 分级粒度
+    static constexpr size_t kMaxBlockSize = 512;  // 超过该大小的对象直接使用operator new（不含块头部）
+
+    static void* allocate(size_t bytes);
+    static void deallocate(void* ptr, size_t bytes);
+};
+
+// 基于BlockPool的标准分配器，可用于std::promise、std::allocate_shared等
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(BlockPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        BlockPool::deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+// 只可移动的无返回值任务，可调用对象不超过kInlineSize时直接存放在对象内部（小缓冲区优化），
+// 与std::function不同，入队、出队和执行都不会分配堆内存
+class SmallTask {
+public:
+    static constexpr size_t kInlineSize = 96;
+
+    SmallTask() noexcept = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SmallTask>>>
+    SmallTask(F&& f) {
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<Fn>) {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &kInlineOps<Fn>;
+        } else {
+            // 捕获过多的任务退化为堆分配
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &kHeapOps<Fn>;
+        }
+    }
+
+    SmallTask(SmallTask&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    SmallTask& operator=(SmallTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    SmallTask(const SmallTask&) = delete;
+    SmallTask& operator=(const SmallTask&) = delete;
+
+    ~SmallTask() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+private:
+    // 手写的虚函数表，每种可调用对象类型一份
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src) noexcept;   // 移动到dst并析构src
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template<typename Fn>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<Fn*>(storage))(); },
+        [](void* dst, void* src) noexcept {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* storage) noexcept { static_cast<Fn*>(storage)->~Fn(); }
+    };
+
+    template<typename Fn>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<Fn**>(storage))(); },
+        [](void* dst, void* src) noexcept { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+        [](void* storage) noexcept { delete *static_cast<Fn**>(storage); }
+    };
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    const Ops* ops_ = nullptr;
+    alignas(std::max_align_t) std::byte storage_[kInlineSize];
+};
+
+// 环形任务队列，容量按2倍增长且从不收缩，稳定运行后入队出队不分配内存
+template<typename T>
+class RingQueue {
+public:
+    bool empty() const noexcept { return size_ == 0; }
+    size_t size() const noexcept { return size_; }
+
+    T& front() noexcept { return slots_[head_]; }
+
+    void push(T&& value) {
+        if (size_ == slots_.size()) {
+            grow();
+        }
+        slots_[(head_ + size_) & (slots_.size() - 1)] = std::move(value);
+        ++size_;
+    }
+
+    void pop() noexcept {
+        slots_[head_] = T();   // 释放任务持有的资源
+        head_ = (head_ + 1) & (slots_.size() - 1);
+        --size_;
+    }
+
+private:
+    void grow() {
+        std::vector<T> slots(slots_.empty() ? 64 : slots_.size() * 2);
+        for (size_t i = 0; i < size_; ++i) {
+            slots[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+        }
+        slots_ = std::move(slots);
+        head_ = 0;
+    }
+
+    std::vector<T> slots_;   // 容量总是2的幂
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+#endif // SMALL_TASK_H
@@ -0,0 +1,264 @@
+#ifndef TEXT_CODEC_H
+#define TEXT_CODEC_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include "thread_pool.h"
+#include "block_io.h"
+
+// 可以使用文本格式读写的记录类型
+template<typename T>
+constexpr bool kTextRecord = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+// 十进制文本格式：每行一个整数，以'\n'结尾（允许"\r\n"，空行跳过）。
+// 解析时每次取8个字节用SWAR判断并转换8位数字，只有每行末尾不足8位的部分逐字节处理；
+// 格式化时先算出位数，再从低位起每次写两位（查表），直接写到输出缓冲区中
+template<typename T>
+struct DecimalTextCodec {
+    static_assert(kTextRecord<T>, "文本格式只支持整数记录");
+
+    using U = std::make_unsigned_t<T>;
+
+    // 一行的最大字节数：符号、最多20位数字和换行符
+    static constexpr size_t kMaxLineBytes = 22;
+
+    // 解析[begin, end)中的完整行追加到out，直到out中有limit个记录；end必须紧跟在一个'\n'之后。
+    // 返回第一个未解析的行的起点
+    static const char* parse(const char* begin, const char* end, std::vector<T>& out, size_t limit) {
+        const char* p = begin;
+        while (p < end && out.size() < limit) {
+            const char* line = p;
+            bool negative = false;
+            if constexpr (std::is_signed_v<T>) {
+                negative = *p == '-';
+                p += negative;
+            }
+
+            // [line, end)中一定有'\n'，逐字节的循环总在到达end之前停下
+            const char* digits = p;
+            uint64_t value = 0;
+            while (end - p >= 8) {
+                uint64_t chunk;
+                std::memcpy(&chunk, p, 8);
+                if (!isEightDigits(chunk)) {
+                    break;
+                }
+                value = value * 100000000 + parseEightDigits(chunk);
+                p += 8;
+            }
+            while (static_cast<unsigned char>(*p - '0') < 10) {
+                value = value * 10 + static_cast<unsigned>(*p - '0');
+                ++p;
+            }
+            const size_t count = p - digits;
+            p += *p == '\r';
+            if (*p != '\n') {
+                fail(line, end);
+            }
+            ++p;
+
+            if (count == 0) {
+                if (negative) {
+                    fail(line, end);
+                }
+                continue;   // 空行
+            }
+            if (count >= 20) {
+                value = parseChecked(digits, count, line, end);   // 可能超出uint64_t，重新按溢出检查解析
+            }
+            const uint64_t limit_value = negative ? static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1
+                                                  : static_cast<uint64_t>(std::numeric_limits<T>::max());
+            if (value > limit_value) {
+                fail(line, end);
+            }
+            out.push_back(negative ? static_cast<T>(U(0) - static_cast<U>(value)) : static_cast<T>(value));
+        }
+        return p;
+    }
+
+    // 把count个记录格式化为文本行追加到out
+    static void format(const T* data, size_t count, std::vector<char>& out) {
+        size_t base = out.size();
+        out.resize(base + count * kMaxLineBytes);
+        char* cursor = out.data() + base;
+        for (size_t i = 0; i < count; ++i) {
+            cursor = formatLine(data[i], cursor);
+        }
+        out.resize(cursor - out.data());
+    }
+
+private:
+    // 8个字节是否都是'0'到'9'：高半字节为3，且加6之后高半字节仍为3
+    static bool isEightDigits(uint64_t chunk) {
+        return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+                (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+    }
+
+    // 把小端序读入的8位十进制数字转换为数值：相邻的位两两合并，再四四合并，最后合并两半
+    static uint32_t parseEightDigits(uint64_t chunk) {
+        chunk -= 0x3030303030303030ULL;
+        chunk = chunk * 10 + (chunk >> 8);
+        chunk = (((chunk & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+                 (((chunk >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+        return static_cast<uint32_t>(chunk);
+    }
+
+    static uint64_t parseChecked(const char* digits, size_t count, const char* line, const char* end) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (__builtin_mul_overflow(value, 10, &value) ||
+                __builtin_add_overflow(value, static_cast<uint64_t>(digits[i] - '0'), &value)) {
+                fail(line, end);
+            }
+        }
+        return value;
+    }
+
+    [[noreturn]] static void fail(const char* line, const char* end) {
+        const char* newline = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        size_t length = std::min<size_t>((newline ? newline : end) - line, 64);
+        throw std::runtime_error("无法解析的文本记录: \"" + std::string(line, length) + "\"");
+    }
+
+    static char* formatLine(T record, char* cursor) {
+        uint64_t value = static_cast<U>(record);
+        if constexpr (std::is_signed_v<T>) {
+            if (record < 0) {
+                *cursor++ = '-';
+                value = static_cast<U>(U(0) - static_cast<U>(record));
+            }
+        }
+
+        const size_t count = digitCount(value);
+        char* p = cursor + count;
+        while (value >= 100) {
+            p -= 2;
+            std::memcpy(p, kDigitPairs + (value % 100) * 2, 2);
+            value /= 100;
+        }
+        if (value >= 10) {
+            std::memcpy(p - 2, kDigitPairs + value * 2, 2);
+        } else {
+            p[-1] = static_cast<char>('0' + value);
+        }
+        cursor[count] = '\n';
+        return cursor + count + 1;
+    }
+
+    // 十进制位数：由二进制位数估计log10，再与10的幂比较修正一位；0按1位计
+    static size_t digitCount(uint64_t value) {
+        value |= 1;
+        size_t estimate = (std::bit_width(value) * 1233) >> 12;
+        return estimate + 1 - (value < kPowersOf10[estimate]);
+    }
+
+    static constexpr uint64_t kPowersOf10[20] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+        1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+        100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+        1000000000000000000ULL, 10000000000000000000ULL};
+
+    static constexpr char kDigitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+};
+
+// 输入文件读取器：二进制输入直接由BlockReader预读；文本输入由BlockReader预读字节，
+// 在调用线程（预排序的计算线程）上按行解析，只解析到已读入的最后一个换行符，不完整的行留到读入下一个块之后
+template<typename T>
+class InputReader {
+public:
+    InputReader(const std::string& path, ThreadPool& io_pool, size_t block_elements, bool text)
+        : path_(path), block_elements_(std::max<size_t>(block_elements, 1)) {
+        if (!text) {
+            raw_ = std::make_unique<BlockReader<T>>(path, io_pool, block_elements_);
+            return;
+        }
+        if constexpr (kTextRecord<T>) {
+            text_ = std::make_unique<BlockReader<char>>(path, io_pool,
+                                                        std::max<size_t>(block_elements_ * sizeof(T), 4096));
+        } else {
+            throw std::runtime_error("只有整数记录支持文本输入");
+        }
+    }
+
+    // 取出下一批记录（最多block_elements个），文件读完时返回false且block为空
+    bool read(std::vector<T>& block) {
+        if (raw_) {
+            return raw_->read(block);
+        }
+        block.clear();
+        while (parseLines(block)) {
+            if (!appendChunk(text_->read(chunk_))) {
+                break;
+            }
+        }
+        return !block.empty();
+    }
+
+    void close() {
+        if (raw_) {
+            raw_->close();
+        } else {
+            text_->close();
+        }
+    }
+
+private:
+    // 解析已读入的完整行直到block装满；完整的行都已解析时丢弃已解析的字节并返回true，表示需要再读入下一个块
+    bool parseLines(std::vector<T>& block) {
+        if constexpr (kTextRecord<T>) {
+            while (block.size() < block_elements_) {
+                if (pending_pos_ < complete_) {
+                    pending_pos_ = DecimalTextCodec<T>::parse(pending_.data() + pending_pos_, pending_.data() + complete_,
+                                                              block, block_elements_) - pending_.data();
+                    continue;
+                }
+
+                pending_.erase(pending_.begin(), pending_.begin() + pending_pos_);
+                complete_ = 0;
+                pending_pos_ = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 追加读入的字节块（chunk_）并找到最后一个换行符，文件已读完时返回false；最后一行没有换行符时补上
+    bool appendChunk(bool read) {
+        if (!read) {
+            if (pending_.empty()) {
+                return false;
+            }
+            pending_.push_back('\n');
+            complete_ = pending_.size();
+            return true;
+        }
+        pending_.insert(pending_.end(), chunk_.begin(), chunk_.end());
+        const void* newline = memrchr(pending_.data() + complete_, '\n', pending_.size() - complete_);
+        if (newline) {
+            complete_ = static_cast<const char*>(newline) - pending_.data() + 1;
+        }
+        return true;
+    }
+
+    std::string path_;
+    size_t block_elements_;
+    std::unique_ptr<BlockReader<T>> raw_;
+    std::unique_ptr<BlockReader<char>> text_;
+    std::vector<char> chunk_;     // 从读取器取得的原始字节块
+    std::vector<char> pending_;   // 尚未解析的字节
+    size_t pending_pos_ = 0;      // 下一个未解析的行的起点
+    size_t complete_ = 0;         // 最后一个换行符之后的位置，之前都是完整的行
+};
+
+#endif // TEXT_CODEC_H
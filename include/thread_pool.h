@@ -2,7 +2,6 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -10,10 +9,44 @@
 #include <functional>
 #include <atomic>
 #include <memory>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "small_task.h"
+
+// 线程池运行时统计快照，由ThreadPool::stats()生成
+struct ThreadPoolStats {
+    // 以2为底的对数直方图，第i个桶统计耗时落在[2^i, 2^(i+1))微秒内的任务数，第0个桶包含不足1微秒的任务
+    static constexpr size_t kHistogramBuckets = 32;
+    using Histogram = std::array<uint64_t, kHistogramBuckets>;
+
+    struct Worker {
+        uint64_t tasks = 0;     // 执行的任务数
+        uint64_t busy_us = 0;   // 执行任务的时间
+        uint64_t idle_us = 0;   // 等待任务的时间
+    };
+
+    uint64_t tasks_submitted = 0;
+    uint64_t tasks_completed = 0;
+    size_t queue_depth = 0;       // 当前队列中的任务数
+    size_t max_queue_depth = 0;   // 统计周期内的最大队列长度
+    uint64_t total_queue_wait_us = 0;
+    uint64_t total_run_us = 0;
+    Histogram queue_wait_histogram{};   // 任务从提交到开始执行的等待时间
+    Histogram run_time_histogram{};     // 任务执行时间
+    std::vector<Worker> workers;
+
+    // 根据直方图估算分位数（返回所在桶的上界，单位微秒）
+    static uint64_t percentileUs(const Histogram& histogram, double p);
+
+    // 格式化为便于打印的多行文本
+    std::string toString() const;
+};
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t num_threads);
+    explicit ThreadPool(size_t num_threads);   // num_threads为0时使用detectCpuCount()
     ~ThreadPool();
 
     // 删除拷贝构造函数和赋值运算符
@@ -24,15 +57,89 @@ public:
     template<typename F, typename... Args>
     auto submit(F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>;
 
+    // 提交不需要结果的任务，不创建future，用于恢复挂起的协程（见coro_task.h）。任务不应抛出异常
+    void post(SmallTask task);
+
+    // 运行时调整工作线程数量，无需重建线程池。缩容时被移除的线程执行完当前任务后退出，
+    // 本函数会等待它们退出，因此不能在本线程池的任务中调用
+    void resize(size_t num_threads);
+
+    // 当前工作线程数量
+    size_t size() const;
+
+    // 检测当前进程实际可用的CPU数量：取调度亲和性掩码中的CPU数与cgroup（v1/v2）CPU配额中的较小值，
+    // 容器中hardware_concurrency()返回的是宿主机核心数，直接使用会严重超额订阅
+    static size_t detectCpuCount();
+
+    // 获取运行时统计快照，开销很小，可在生产环境中随时调用
+    ThreadPoolStats stats() const;
+
+    // 清零统计数据，开始新的统计周期（例如排序的每个阶段）
+    void resetStats();
+
 private:
-    // 工作线程容器
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedTask {
+        SmallTask fn;
+        Clock::time_point enqueue_time;   // 入队时间，用于统计排队等待时间
+    };
+
+    // 每个工作线程独占的统计计数器，只由所属线程写入，使用relaxed原子操作，
+    // 按缓存行对齐避免线程之间的伪共享
+    struct alignas(64) WorkerCounters {
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> idle_ns{0};
+        std::atomic<uint64_t> queue_wait_ns{0};
+        std::array<std::atomic<uint64_t>, ThreadPoolStats::kHistogramBuckets> queue_wait_histogram{};
+        std::array<std::atomic<uint64_t>, ThreadPoolStats::kHistogramBuckets> run_time_histogram{};
+    };
+
+    void workerLoop(size_t index, WorkerCounters& counters);
+
+    // 当前线程正在执行的任务，counters为空表示没有未记录完成的任务
+    struct RunningTask {
+        WorkerCounters* counters = nullptr;
+        Clock::time_point start;
+    };
+    static thread_local RunningTask running_task_;
+
+    // 把当前线程正在执行的任务记为完成（执行时间、直方图、完成数），每个任务只记录一次。
+    // submit的任务在通过promise发布结果之前调用，future就绪时统计中一定已计入该任务
+    static void completeRunningTask();
+
+    // 工作线程容器，workers_和worker_counters_的结构变化由workers_mutex_保护
+    mutable std::mutex workers_mutex_;
     std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkerCounters>> worker_counters_;   // 按线程序号保存，缩容后保留以便扩容时复用
+
+    // 缩容时被移除的线程的累计统计，由workers_mutex_保护。被移除线程的计数器折算到这里后清零，
+    // 扩容复用这些计数器时不会重复计入，缩容前后的累计值不会减少
+    struct RetiredCounters {
+        uint64_t tasks = 0;
+        uint64_t busy_ns = 0;
+        uint64_t queue_wait_ns = 0;
+        ThreadPoolStats::Histogram queue_wait_histogram{};
+        ThreadPoolStats::Histogram run_time_histogram{};
+    };
+    RetiredCounters retired_;
+
+    // 把counters折算到retired_并清零，调用者持有workers_mutex_且对应的线程已退出
+    void retireCounters(WorkerCounters& counters);
+
+    // 目标线程数，序号不小于该值的工作线程退出，由queue_mutex_保护
+    size_t active_threads_ = 0;
     
     // 任务队列
-    std::queue<std::function<void()>> tasks_;
+    RingQueue<QueuedTask> tasks_;
+
+    // 队列统计，仅在持有queue_mutex_时更新
+    uint64_t tasks_submitted_ = 0;
+    size_t max_queue_depth_ = 0;
     
     // 同步原语
-    std::mutex queue_mutex_;
+    mutable std::mutex queue_mutex_;
     std::condition_variable condition_;
     
     // 停止标志
@@ -46,30 +153,34 @@ auto ThreadPool::submit(F&& f, Args&&... args)
 {
     using return_type = std::invoke_result_t<F, Args...>;
 
-    // 包装任务，完美转移参数，减少拷贝
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-    [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
-        return std::apply(f, std::move(args));
-    }
-    );
+    // future共享状态从内存池分配，避免每次提交都申请堆内存
+    std::promise<return_type> promise(std::allocator_arg, PoolAllocator<char>());
 
     // 创建一个 future 用于获取任务结果
-    std::future<return_type> res = task->get_future();
+    std::future<return_type> res = promise.get_future();
 
-    // 将任务添加到任务队列
-    {
-        std::unique_lock<std::mutex> lock(this->queue_mutex_);  // 加锁保护任务队列，退出作用域时自动解锁
-        
-        // 防止在停止后提交任务
-        if (this->stop_) {
-            throw std::runtime_error("submit on stopped ThreadPool");
+    // 包装任务，完美转移参数，减少拷贝；只捕获少量指针的任务直接存放在SmallTask内部
+    SmallTask task(
+    [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...), promise = std::move(promise)]() mutable {
+        try {
+            if constexpr (std::is_void_v<return_type>) {
+                std::apply(f, std::move(args));
+                completeRunningTask();
+                promise.set_value();
+            } else {
+                return_type value = std::apply(f, std::move(args));
+                completeRunningTask();
+                promise.set_value(std::forward<return_type>(value));
+            }
+        } catch (...) {
+            completeRunningTask();
+            promise.set_exception(std::current_exception());
         }
-        
-        this->tasks_.emplace([task]() { (*task)(); });
     }
-    
-    // 唤醒一个等待线程
-    this->condition_.notify_one();
+    );
+
+    // 将任务添加到任务队列
+    post(std::move(task));
     return res;
 }
 
@@ -0,0 +1,95 @@
+#ifndef VARLEN_SORT_H
+#define VARLEN_SORT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "external_merge_sort.h"
+
+// 变长记录：按键的字节序（memcmp，较短的前缀在前）排序，值随键一起移动。
+// 输入文件为连续的记录：[uint32 键长][uint32 值长][键][值]
+struct VarLenRecord {
+    std::string_view key;
+    std::string_view value;
+};
+
+// 变长记录的编码与比较
+struct VarLenFormat {
+    static constexpr size_t kRecordHeaderBytes = 2 * sizeof(uint32_t);
+    static constexpr size_t kFrameHeaderBytes = 2 * sizeof(uint32_t);   // [uint32 负载字节数][uint32 记录数]
+
+    // 追加一条记录的编码
+    static void append(std::string& out, std::string_view key, std::string_view value);
+
+    // 解析data开头的一条记录，数据不完整时返回0，否则返回记录占用的字节数
+    static size_t parse(const char* data, size_t size, VarLenRecord& record);
+
+    // 键的8字节规范化前缀：前8字节按大端拼成整数，不足补0，前缀的大小顺序与键的字节序一致
+    static uint64_t keyPrefix(std::string_view key);
+
+    // 完整比较两个键
+    static bool keyLess(std::string_view a, std::string_view b) {
+        return a < b;
+    }
+};
+
+// 块格式的变长记录读取器：run文件和输出文件由若干帧组成，每帧为
+// [uint32 负载字节数][uint32 记录数][记录...]，帧内只包含完整的记录，读取时由I/O线程池预读
+class VarLenRunReader {
+public:
+    VarLenRunReader(const std::string& path, ThreadPool& io_pool, size_t block_bytes);
+
+    // 读取下一条记录，返回的视图在下一次调用next前有效；读完时返回false
+    bool next(VarLenRecord& record);
+
+    void close();
+
+private:
+    // 保证缓冲区中至少有一个完整的帧，文件读完时返回false
+    bool loadFrame();
+
+    std::string path_;
+    BlockReader<char> reader_;
+    std::vector<char> block_;     // 从读取器取得的原始块
+    std::vector<char> pending_;   // 尚未解析的字节，帧可能跨越多个块
+    size_t pending_pos_ = 0;
+    size_t frame_end_ = 0;        // 当前帧在pending_中的结束位置
+};
+
+// 块格式的变长记录写入器，记录攒满一帧后交给BlockWriter异步写出；expected_bytes为预留的磁盘空间
+class VarLenRunWriter {
+public:
+    VarLenRunWriter(const std::string& path, ThreadPool& io_pool, size_t frame_bytes, uint64_t expected_bytes = 0);
+
+    void write(const VarLenRecord& record);
+    void close();
+
+private:
+    void flushFrame();
+
+    BlockWriter<char> writer_;
+    size_t frame_bytes_;
+    std::vector<char> frame_;
+    uint32_t frame_records_ = 0;
+};
+
+// 变长记录外部排序器，复用基类的调度和分层归并流程。
+// 预排序对(8字节前缀, 偏移)数组排序，前缀相同才访问键本身；归并堆的节点同样缓存前缀
+class VarLenExternalMergeSorter : public ExternalMergeSorterBase {
+public:
+    using ExternalMergeSorterBase::ExternalMergeSorterBase;
+
+    // 帧的目标大小
+    static constexpr size_t kFrameBytes = 64 * 1024;
+
+private:
+    ChunkInfo processFile(const std::string& filepath) override;
+    void mergeFiles(const std::vector<std::string>& files, const std::string& output_file) override;
+
+    // 将arena中已解析的一批记录排序后写成一个run文件
+    void writeSortedRun(const std::vector<char>& arena, std::vector<std::pair<uint64_t, uint32_t>>& entries,
+                        const std::string& filename);
+};
+
+#endif // VARLEN_SORT_H
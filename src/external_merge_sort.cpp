@@ -3,27 +3,28 @@
 #include <fstream>
 #include <algorithm>
 #include <filesystem>
-#include <queue>
 #include <cstring>
 #include <sys/resource.h>
 
 namespace fs = std::filesystem;
 
 // 辅助函数，获取当前进程的内存使用情况
-const double ExternalMergeSorter::get_memory_usage_mb() {
+const double ExternalMergeSorterBase::get_memory_usage_mb() {
         struct rusage usage;
         getrusage(RUSAGE_SELF, &usage);
         return usage.ru_maxrss / 1024.0; // ru_maxrss以KB为单位
 }
 
-ExternalMergeSorter::ExternalMergeSorter(const std::string& input_dir,
+ExternalMergeSorterBase::ExternalMergeSorterBase(const std::string& input_dir,
                                          const std::string& output_file,
                                          size_t memory_limit,
-                                         size_t num_threads)
+                                         size_t num_threads,
+                                         size_t io_threads)
     : input_dir_(input_dir), 
       output_file_(output_file),
       memory_limit_(memory_limit),
-      num_threads_(num_threads) {
+      num_threads_(num_threads),
+      io_threads_(io_threads) {
     // 线程数量等于CPU核心数
 
     if (num_threads_ < 0) {
@@ -31,17 +32,23 @@ ExternalMergeSorter::ExternalMergeSorter(const std::string& input_dir,
         return;
     }
     else if(num_threads_ == 0){
-        // 使用CPU核心数
-        num_threads_ = std::thread::hardware_concurrency();
+        // 使用进程实际可用的CPU核心数（考虑cgroup配额和调度亲和性）
+        num_threads_ = ThreadPool::detectCpuCount();
     }
     
-    // 创建线程池
-    thread_pool_ = std::make_unique<ThreadPool>(num_threads_);
-    std::cout << "线程池创建成功，线程数: " << num_threads_ << std::endl;
+    if (io_threads_ == 0) {
+        io_threads_ = kDefaultIoThreads;
+    }
+    
+    // 创建计算线程池和I/O线程池
+    compute_pool_ = std::make_unique<ThreadPool>(num_threads_);
+    io_pool_ = std::make_unique<ThreadPool>(io_threads_);
+    std::cout << "线程池创建成功，计算线程数: " << num_threads_ << "，I/O线程数: " << io_threads_ << std::endl;
 }
 
-void ExternalMergeSorter::sort() {
+void ExternalMergeSorterBase::sort() {
     std::cout << "开始分割和预排序阶段..." << std::endl;
+    resetPoolStats();
     auto start_time = std::chrono::high_resolution_clock::now();
     
     auto chunks = splitAndPresort();
@@ -50,8 +57,10 @@ void ExternalMergeSorter::sort() {
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     std::cout << "分割和预排序完成，耗时: " << duration.count() << "ms" << std::endl;
     std::cout << "内存使用: " << get_memory_usage_mb() << "MB" << std::endl;
+    printPoolStats();
     
     std::cout << "开始多路归并阶段..." << std::endl;
+    resetPoolStats();
     start_time = std::chrono::high_resolution_clock::now();
 
     mergeChunks(chunks);
@@ -60,12 +69,145 @@ void ExternalMergeSorter::sort() {
     duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     std::cout << "多路归并完成，耗时: " << duration.count() << "ms" << std::endl;
     std::cout << "内存使用: " << get_memory_usage_mb() << "MB" << std::endl;
+    printPoolStats();
     
     std::cout << "排序完成，结果保存至: " << output_file_ << std::endl;
 }
 
+// 清零两个线程池和归约的统计数据，开始新阶段的统计
+void ExternalMergeSorterBase::resetPoolStats() {
+    compute_pool_->resetStats();
+    io_pool_->resetStats();
+    reduce_input_ = 0;
+    reduce_output_ = 0;
+    copied_runs_ = 0;
+}
+
+// 输出两个线程池在当前阶段的统计数据，本阶段做过归约时同时输出归约前后的记录数
+void ExternalMergeSorterBase::printPoolStats() const {
+    std::cout << "[计算线程池] " << compute_pool_->stats().toString();
+    std::cout << "[I/O线程池] " << io_pool_->stats().toString();
+
+    uint64_t input = reduce_input_.load();
+    if (input > 0) {
+        uint64_t output = reduce_output_.load();
+        std::cout << "[归约] 输入记录数: " << input << "，输出记录数: " << output
+                  << "，保留比例: " << 100.0 * output / input << "%" << std::endl;
+    }
+}
+
+void ExternalMergeSorterBase::setTempDirs(const std::vector<std::string>& dirs) {
+    // 规范化目录名（去掉"./"、多余的分隔符和末尾的'/'），按所在目录给run分桶时才能与run路径的父目录比较
+    std::vector<std::string> normalized;
+    for (const auto& dir : dirs) {
+        fs::create_directories(dir);
+        fs::path path = fs::path(dir).lexically_normal();
+        if (!path.has_filename() && path.has_relative_path()) {
+            path = path.parent_path();
+        }
+        normalized.push_back(path.string());
+    }
+    temp_dirs_ = std::move(normalized);
+}
+
+void ExternalMergeSorterBase::setMemoryTempDir(const std::string& dir, uint64_t budget_bytes, uint64_t max_run_bytes) {
+    fs::create_directories(dir);
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    memory_dir_ = dir;
+    memory_budget_ = budget_bytes;
+    memory_max_run_ = max_run_bytes;
+}
+
+std::string ExternalMergeSorterBase::tempPath(const std::string& default_path, uint64_t bytes) {
+    auto inDir = [&](const std::string& dir) {
+        return (fs::path(dir) / (fs::path(default_path).filename().string() + "." + std::to_string(next_temp_++)))
+            .string();
+    };
+
+    if (!memory_dir_.empty() && bytes <= memory_max_run_) {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        if (memory_used_ + bytes <= memory_budget_) {
+            std::string path = inDir(memory_dir_);
+            memory_used_ += bytes;
+            memory_runs_.emplace(path, bytes);
+            return path;
+        }
+    }
+
+    if (temp_dirs_.empty()) {
+        return default_path;
+    }
+    return inDir(temp_dirs_[next_dir_++ % temp_dirs_.size()]);
+}
+
+void ExternalMergeSorterBase::releaseTemp(const std::vector<std::string>& files) {
+    if (memory_dir_.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    for (const auto& file : files) {
+        auto it = memory_runs_.find(file);
+        if (it != memory_runs_.end()) {
+            memory_used_ -= it->second;
+            memory_runs_.erase(it);
+        }
+    }
+}
+
+void ExternalMergeSorterBase::reclaimMemoryTemp() {
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    for (auto it = memory_runs_.begin(); it != memory_runs_.end();) {
+        if (fs::exists(it->first)) {
+            ++it;
+        } else {
+            memory_used_ -= it->second;
+            it = memory_runs_.erase(it);
+        }
+    }
+}
+
+uint64_t ExternalMergeSorterBase::totalFileBytes(const std::vector<std::string>& files) {
+    uint64_t bytes = 0;
+    for (const auto& file : files) {
+        bytes += fs::file_size(file);
+    }
+    return bytes;
+}
+
+void ExternalMergeSorterBase::interleaveByTempDir(std::vector<std::string>& files) const {
+    if (temp_dirs_.size() < 2) {
+        return;
+    }
+
+    // 按所在目录分桶（不在任何临时目录中的文件单独一桶），再轮流从各桶取一个
+    std::vector<std::vector<std::string>> buckets(temp_dirs_.size() + 1);
+    for (auto& file : files) {
+        fs::path parent = fs::path(file).parent_path();
+        size_t dir = 0;
+        while (dir < temp_dirs_.size() && parent != fs::path(temp_dirs_[dir])) {
+            ++dir;
+        }
+        buckets[dir].push_back(std::move(file));
+    }
+
+    files.clear();
+    for (size_t i = 0;; ++i) {
+        bool any = false;
+        for (auto& bucket : buckets) {
+            if (i < bucket.size()) {
+                files.push_back(std::move(bucket[i]));
+                any = true;
+            }
+        }
+        if (!any) {
+            break;
+        }
+    }
+}
+
 // 第一阶段：分割和预排序
-std::vector<ExternalMergeSorter::ChunkInfo> ExternalMergeSorter::splitAndPresort() {
+std::vector<ExternalMergeSorterBase::ChunkInfo> ExternalMergeSorterBase::splitAndPresort() {
+    reclaimMemoryTemp();   // 上一次排序的拉取式输出、Top-K等可能已删除了内存临时层中的run
     auto files = getAllFiles(input_dir_); // 获取所有文件
     if (files.empty()) {
         return {};
@@ -80,11 +222,15 @@ std::vector<ExternalMergeSorter::ChunkInfo> ExternalMergeSorter::splitAndPresort
         return chunks;
     }
 
+    // 最长任务优先（LPT）调度：处理耗时与文件大小成正比，按大小降序提交，
+    // 避免最大的文件最后才开始而拖长整个阶段的尾部
+    sortBySizeDescending(files);
+
     std::vector<std::future<ChunkInfo>> futures;
 
     // 并行处理所有文件
     for (const auto& file : files) {
-        auto future = thread_pool_->submit(&ExternalMergeSorter::processFile, this, file);
+        auto future = pool(Stage::Presort).submit(&ExternalMergeSorterBase::processFile, this, file);
         // 收集所有future
         futures.push_back(std::move(future));
     }
@@ -98,301 +244,158 @@ std::vector<ExternalMergeSorter::ChunkInfo> ExternalMergeSorter::splitAndPresort
     return chunks;
 }
 
-ExternalMergeSorter::ChunkInfo ExternalMergeSorter::processFile(const std::string& filepath) {
-    // 内存限制
-    size_t max_elements = memory_limit_ / sizeof(int64_t) / (num_threads_ > 0 ? num_threads_ : 1);
-    std::vector<int64_t> buffer;
-    buffer.reserve(max_elements);
-
-    std::ifstream input(filepath, std::ios::binary);
-    if (!input.is_open())
-    {
-        throw std::runtime_error("无法打开文件: " + filepath);
-    }
-
-    // 创建主临时文件名
-    std::string temp_filename = filepath + ".sorted";
-    
-    ChunkInfo info;
-    info.temp_file = temp_filename;
-    info.data_count = 0;
-    
-    bool finished = false;
-    size_t chunk_index = 0;
-    
-    // 存储所有中间chunk文件
-    std::vector<std::string> chunk_files;
-    
-    while (!finished) {
-        buffer.clear();
-        
-        // 读取一批数据到缓冲区
-        for (size_t i = 0; i < max_elements; ++i) {
-            int64_t value;
-            if (input.read(reinterpret_cast<char*>(&value), sizeof(value))) {
-                buffer.push_back(value);
-                info.data_count++;
-            } else {
-                finished = true;
-                break;
-            }
-        }
-        
-        // 排序缓冲区内的数据
-        std::sort(buffer.begin(), buffer.end());
-        
-        // 将排序后的数据写入临时chunk文件
-        std::string chunk_filename = temp_filename + ".chunk" + std::to_string(chunk_index++);
-        chunk_files.push_back(chunk_filename);
-        
-        std::ofstream output(chunk_filename, std::ios::binary);
-        if (!output.is_open()) {
-            throw std::runtime_error("无法创建临时文件: " + chunk_filename);
-        }
-        
-        for (const auto& value : buffer) {
-            output.write(reinterpret_cast<const char*>(&value), sizeof(value));
-        }
-        output.close();
-    }
-    
-    input.close();
-    // 释放缓冲区内存
-    buffer.clear();
-    buffer.shrink_to_fit();
-    
-    // 合并所有生成的chunk文件
-    if (chunk_files.size() == 1) {
-        // 只有一个chunk，直接重命名为最终的临时文件
-        fs::rename(chunk_files[0], temp_filename);
-    } 
-    else if (chunk_files.size() > 1) {
-        // 多个chunk，需要进行内部归并
-        mergeFiles(chunk_files, temp_filename);
-    }
-    
-    return info;
-}
-
 // 多路归并多个已排序的文件到输出文件，支持多线程分层归并
-void ExternalMergeSorter::mergeChunks(const std::vector<ChunkInfo>& chunks) {
+void ExternalMergeSorterBase::mergeChunks(const std::vector<ChunkInfo>& chunks) {
     if (chunks.empty()) {
         return;
     }
     
-    // 如果只有一个文件，直接复制即可
-    if (chunks.size() == 1) {
-        fs::copy_file(chunks[0].temp_file, output_file_, fs::copy_options::overwrite_existing);
-        return;
-    }
-
-    if (num_threads_ < 0) {
-        // 单线程处理
-        std::vector<std::string> filenames;
+    // 只有一个文件时交给mergeFiles复制（run格式与输出格式不同时由其转换）；单线程时直接归并所有文件
+    std::vector<std::string> final_runs;
+    if (chunks.size() == 1 || num_threads_ < 0) {
         for (const auto& chunk : chunks) {
-            filenames.push_back(chunk.temp_file);
+            final_runs.push_back(chunk.temp_file);
         }
-        mergeFiles(filenames, output_file_);
-        return;
+    } else {
+        // 中间轮次把每组重叠的run降到kMergeFactor以内，最后一轮归并各组、复制不重叠的run到输出文件
+        final_runs = reduceRuns(chunks, kMergeFactor, true);
     }
+    mergeFiles(final_runs, output_file_);
+    releaseTemp(final_runs);
+}
 
-    const size_t merge_factor = 128; // 每轮最多合并128个文件
-    
-    // 如果chunks数量较少，直接单线程多路归并
-    if (chunks.size() <= merge_factor) {
-        std::vector<std::string> filenames;
-        for (const auto& chunk : chunks) {
-            filenames.push_back(chunk.temp_file);
-        }
-        mergeFiles(filenames, output_file_);
-        return;
-    }
-    
-    // 如果chunks数量很多，采用多线程分层并归策略
+std::vector<std::string> ExternalMergeSorterBase::reduceRuns(const std::vector<ChunkInfo>& chunks, size_t max_runs,
+                                                             bool by_overlap) {
     std::vector<std::string> current_files;
     for (const auto& chunk : chunks) {
         current_files.push_back(chunk.temp_file);
     }
     
-    // 循环合并直到只剩一个文件
+    // 归并轮次中可能缩容计算线程池，返回或抛出异常时都恢复原来的线程数
+    PoolSizeScope compute_size(*compute_pool_);
+
+    // 循环合并直到每组的文件数不超过max_runs；不按重叠分组时所有文件为一组
     size_t round = 0;   // 合并轮数
-    while (current_files.size() > 1) {
+    while (current_files.size() > max_runs) {
+        std::vector<std::vector<std::string>> overlaps =
+            by_overlap ? overlapGroups(current_files) : std::vector<std::vector<std::string>>{current_files};
+        if (std::all_of(overlaps.begin(), overlaps.end(),
+                        [max_runs](const auto& overlap) { return overlap.size() <= max_runs; })) {
+            break;
+        }
+
         std::vector<std::string> next_round_files; // 下一轮的文件列表
         
         // 使用线程池并行处理多个合并任务
-        std::vector<std::future<std::string>> futures;  // 保存每个合并任务的future，以便等待完成
+        std::vector<std::future<void>> futures;  // 保存每个归并协程的future，以便等待完成
         std::vector<std::vector<std::string>> files_groups;  // 每组文件的列表
         std::vector<std::string> intermediate_files;  // 每组合并后的输出文件名
         
-        // 将当前文件分组，每组进行合并
-        for (size_t i = 0; i < current_files.size(); i += merge_factor) {
-            size_t end = std::min(i + merge_factor, current_files.size());
-            std::vector<std::string> files_to_merge(current_files.begin() + i, current_files.begin() + end);
-            
-            if (files_to_merge.size() == 1) {
-                // 单个文件无需合并
-                next_round_files.push_back(files_to_merge[0]);
-            } else {
-                // 准备并行合并任务
-                std::string intermediate_file = output_file_ + ".intermediate" + "_r" + std::to_string(round) + 
-                    "_g" + std::to_string(files_groups.size()) + "_" + std::to_string(i);
-                intermediate_files.push_back(intermediate_file);
-                files_groups.push_back(std::move(files_to_merge));
+        // 将每组重叠的文件再分组，每组进行合并；run数已经足够少的重叠组本轮不动。
+        // 切分前按临时目录交错排列，每组归并的输入分散在各个设备上
+        for (auto& overlap : overlaps) {
+            if (overlap.size() <= max_runs) {
+                next_round_files.insert(next_round_files.end(), overlap.begin(), overlap.end());
+                continue;
+            }
+            interleaveByTempDir(overlap);
+            for (size_t i = 0; i < overlap.size(); i += kMergeFactor) {
+                size_t end = std::min(i + kMergeFactor, overlap.size());
+                std::vector<std::string> files_to_merge(overlap.begin() + i, overlap.begin() + end);
+
+                if (files_to_merge.size() == 1) {
+                    // 单个文件无需合并
+                    next_round_files.push_back(files_to_merge[0]);
+                } else {
+                    // 准备并行合并任务
+                    std::string intermediate_file = tempPath(output_file_ + ".intermediate" + "_r" + std::to_string(round) +
+                        "_g" + std::to_string(files_groups.size()) + "_" + std::to_string(i), totalFileBytes(files_to_merge));
+                    intermediate_files.push_back(intermediate_file);
+                    files_groups.push_back(std::move(files_to_merge));
+                }
             }
         }
         
-        // 提交并行任务
-        for (size_t i = 0; i < files_groups.size(); ++i) {
-            auto future = thread_pool_->submit([this, files_group = std::move(files_groups[i]), 
-                                               output_file = std::move(intermediate_files[i])]() {
-                this->mergeFiles(files_group, output_file);
-                // 返回需要删除的源文件列表，生成的中间文件
-                return std::move(output_file);
-            });
-            futures.push_back(std::move(future));
+        // 归并轮次以I/O为主，本轮归并任务比计算线程少时缩容到任务数，把多余的CPU让给其他进程；
+        // 任务多于线程时保持原样，避免每轮都销毁再创建线程
+        compute_size.shrinkTo(files_groups.size());
+
+        // 每组归并是一个协程，等待预读和写出时挂起，计算线程转而推进其他组的归并。
+        // 协程数不超过计算线程数，各自依次领取尚未归并的组，同时进行的归并数和内存占用与按组提交任务时相同
+        std::atomic<size_t> next_group{0};
+        size_t workers = std::min(files_groups.size(), pool(Stage::Merge).size());
+        for (size_t i = 0; i < workers; ++i) {
+            futures.push_back(spawn(pool(Stage::Merge), mergeGroups(files_groups, intermediate_files, next_group)));
         }
 
-        // 等待所有并行任务完成，收集结果
+        // 等待所有协程结束后再取结果，出错时其他协程仍在使用本函数的局部变量
         for (auto& future : futures) {
-            next_round_files.push_back(future.get());
+            future.wait();
         }
+        for (auto& future : futures) {
+            future.get();
+        }
+        for (const auto& group : files_groups) {
+            releaseTemp(group);
+        }
+        next_round_files.insert(next_round_files.end(), intermediate_files.begin(), intermediate_files.end());
         
         current_files = std::move(next_round_files);
         round++;
     }
     
-    // 最终的文件即为输出文件
-    if (!current_files.empty()) {
-        fs::rename(current_files[0], output_file_);
-    }
+    return current_files;
 }
 
+Task<void> ExternalMergeSorterBase::mergeFilesAsync(std::vector<std::string> files, std::string output_file) {
+    mergeFiles(files, output_file);
+    co_return;
+}
 
-// 多路归并多个已排序的文件到输出文件并删除中间排序文件
-void ExternalMergeSorter::mergeFiles(const std::vector<std::string>& files, const std::string& output_file) {
-    if (files.empty()) {
-        return;
-    }
-    
-    if (files.size() == 1) {
-        // 单个文件直接复制
-        fs::copy_file(files[0], output_file, fs::copy_options::overwrite_existing);
-        return;
+Task<void> ExternalMergeSorterBase::mergeGroups(const std::vector<std::vector<std::string>>& groups,
+                                                const std::vector<std::string>& outputs, std::atomic<size_t>& next) {
+    for (size_t i = next++; i < groups.size(); i = next++) {
+        co_await mergeFilesAsync(groups[i], outputs[i]);
     }
+}
 
-    // 为每个输入文件设置缓冲区最大元素数，最小为1防止缓冲区为0
-    const size_t BUFFER_SIZE = std::max(memory_limit_ / (files.size() * sizeof(int64_t)) / (num_threads_ > 0 ? num_threads_ : 1),
-                                        static_cast<size_t>(1));
-    std::vector<std::vector<int64_t>> input_buffers(files.size());
-    std::vector<size_t> buffer_positions(files.size(), 0);
-    std::vector<size_t> buffer_sizes(files.size(), 0);
-
-    // 打开所有输入文件并初始化缓冲区
-    std::vector<std::ifstream> inputs(files.size());
-    for (size_t i = 0; i < files.size(); ++i) {
-        inputs[i].open(files[i], std::ios::binary);
-        if (!inputs[i].is_open()) {
-            // 关闭之前成功打开的所有文件
-            for (size_t j = 0; j < i; ++j) {
-                inputs[j].close();
-            }
-            throw std::runtime_error("无法打开文件: " + files[i]);
-        }
-        // 初始化缓冲区
-        input_buffers[i].resize(BUFFER_SIZE);
-    }
-    
-    // 打开输出文件并设置输出缓冲区
-    std::ofstream output(output_file, std::ios::binary);
-    if (!output.is_open()) {
-        // 关闭所有已打开的输入文件
-        for (auto& input : inputs) {
-            input.close();
-        }
-        throw std::runtime_error("无法创建输出文件: " + output_file);
-    }
-    
-    std::vector<int64_t> output_buffer;
-    output_buffer.reserve(BUFFER_SIZE);
-
-    // 缓冲区填充函数
-    auto fillBuffer = [&](size_t stream_index) {
-        if (buffer_positions[stream_index] >= buffer_sizes[stream_index]) {
-            // 缓冲区已用完，需要从文件读取新数据
-            inputs[stream_index].read(reinterpret_cast<char*>(input_buffers[stream_index].data()), 
-                                     BUFFER_SIZE * sizeof(int64_t));
-            if (inputs[stream_index].eof() && inputs[stream_index].gcount() == 0) {
-                // 文件已读完，关闭流并删除中间顺序文件
-                buffer_sizes[stream_index] = 0;
-                inputs[stream_index].close();
-                fs::remove(files[stream_index]);
-            } else {
-                // 文件未读完，更新缓冲区大小
-                buffer_sizes[stream_index] = inputs[stream_index].gcount() / sizeof(int64_t);
-            }
-            buffer_positions[stream_index] = 0;
-        }
-    };
-    
-    // 使用最小堆进行k路归并
-    struct Element {
-        int64_t value;
-        size_t stream_index;
-        
-        bool operator>(const Element& other) const {
-            return value > other.value;
-        }
-    };
-    
-    std::priority_queue<Element, std::vector<Element>, std::greater<Element>> min_heap;
-    
-    // 初始化堆，从每个文件读取第一个元素
-    for (size_t index = 0; index < files.size(); ++index) {
-        fillBuffer(index);
-        if (buffer_sizes[index] > 0) {
-            // 缓冲区中有数据，将第一个元素放入堆中
-            min_heap.push({input_buffers[index][buffer_positions[index]], index});
-            buffer_positions[index]++;
-        }
-    }
-    
-    // 归并过程
-    while (!min_heap.empty()) {
-        Element elem = min_heap.top();
-        min_heap.pop();
-        
-        // 添加到输出缓冲区
-        output_buffer.push_back(elem.value);
-        if (output_buffer.size() >= BUFFER_SIZE) {
-            // 输出缓冲区满了，写入文件
-            output.write(reinterpret_cast<const char*>(output_buffer.data()), 
-                        output_buffer.size() * sizeof(int64_t));
-            output_buffer.clear();
-        }
-        
-        // 从相同文件流中读取下一个元素
-        fillBuffer(elem.stream_index);
-        if (buffer_positions[elem.stream_index] < buffer_sizes[elem.stream_index]) {
-            min_heap.push({input_buffers[elem.stream_index][buffer_positions[elem.stream_index]], elem.stream_index});
-            buffer_positions[elem.stream_index]++;
-        }
-    }
-    
-    // 写入剩余的输出缓冲区内容
-    if (!output_buffer.empty()) {
-        output.write(reinterpret_cast<const char*>(output_buffer.data()), 
-                    output_buffer.size() * sizeof(int64_t));
+std::vector<std::string> ExternalMergeSorterBase::prepareFinalRuns() {
+    std::cout << "开始分割和预排序阶段..." << std::endl;
+    resetPoolStats();
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    auto chunks = splitAndPresort();
+    auto runs = reduceRuns(chunks, kMergeFactor);
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    std::cout << "预排序和中间归并完成，耗时: " << duration.count() << "ms，剩余run数: " << runs.size() << std::endl;
+    printPoolStats();
+    return runs;
+}
+
+
+// 按文件大小降序排列，大小相同时按路径排序以保证顺序确定
+void ExternalMergeSorterBase::sortBySizeDescending(std::vector<std::string>& files) {
+    std::vector<std::pair<uintmax_t, std::string>> sized;
+    sized.reserve(files.size());
+    for (auto& file : files) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(file, ec);
+        sized.emplace_back(ec ? 0 : size, std::move(file));
     }
-    
-    // 关闭所有文件
-    for (auto& input : inputs) {
-        input.close();
+
+    std::sort(sized.begin(), sized.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    for (size_t i = 0; i < sized.size(); ++i) {
+        files[i] = std::move(sized[i].second);
     }
-    output.close();
 }
 
 // 获取目录下所有普通文件的路径
-std::vector<std::string> ExternalMergeSorter::getAllFiles(const std::string& dir) const {
+std::vector<std::string> ExternalMergeSorterBase::getAllFiles(const std::string& dir) const {
     std::vector<std::string> files;
     
     try {
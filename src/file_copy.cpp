@@ -0,0 +1,140 @@
+#include "file_copy.h"
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+namespace {
+
+// 关闭时自动释放的文件描述符
+struct FileDescriptor {
+    int fd;
+
+    FileDescriptor(const std::string& path, int flags, mode_t mode = 0644) : fd(::open(path.c_str(), flags, mode)) {
+        if (fd < 0) {
+            throw std::runtime_error("无法打开文件: " + path + "，" + std::strerror(errno));
+        }
+    }
+
+    ~FileDescriptor() {
+        ::close(fd);
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+};
+
+constexpr size_t kFallbackBufferBytes = 1 << 20;
+
+}  // namespace
+
+void appendFileRange(const std::string& source, uint64_t offset, uint64_t bytes, const std::string& target) {
+    if (bytes == 0) {
+        return;
+    }
+
+    FileDescriptor input(source, O_RDONLY);
+    // copy_file_range不接受O_APPEND打开的目标，显式给出写入位置
+    FileDescriptor output(target, O_WRONLY);
+    struct stat st;
+    if (::fstat(output.fd, &st) != 0) {
+        throw std::runtime_error("无法获取文件大小: " + target);
+    }
+
+    if (offset == 0 && st.st_size == 0 && ::ioctl(output.fd, FICLONE, input.fd) == 0) {
+        // 整个源文件共享给target，再截掉多出的部分（如run末尾的索引）
+        if (::ftruncate(output.fd, static_cast<off_t>(bytes)) != 0) {
+            throw std::runtime_error("截断文件失败: " + target + "，" + std::strerror(errno));
+        }
+        return;
+    }
+
+    loff_t in_offset = static_cast<loff_t>(offset);
+    loff_t out_offset = st.st_size;
+    uint64_t remaining = bytes;
+    while (remaining > 0) {
+        ssize_t copied = ::copy_file_range(input.fd, &in_offset, output.fd, &out_offset, remaining, 0);
+        if (copied > 0) {
+            remaining -= static_cast<uint64_t>(copied);
+            continue;
+        }
+        if (copied == 0) {
+            throw std::runtime_error("复制文件时源文件提前结束: " + source);
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP && errno != EINVAL) {
+            throw std::runtime_error("复制文件失败: " + source + "，" + std::strerror(errno));
+        }
+
+        // 内核不支持在这两个文件之间复制，用用户态缓冲区完成剩余部分
+        std::vector<char> buffer(kFallbackBufferBytes);
+        while (remaining > 0) {
+            size_t wanted = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            ssize_t got = ::pread(input.fd, buffer.data(), wanted, in_offset);
+            if (got <= 0) {
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("读取文件失败: " + source);
+            }
+            for (ssize_t done = 0; done < got;) {
+                ssize_t put = ::pwrite(output.fd, buffer.data() + done, static_cast<size_t>(got - done), out_offset);
+                if (put < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error("写入文件失败: " + target);
+                }
+                done += put;
+                out_offset += put;
+            }
+            in_offset += got;
+            remaining -= static_cast<uint64_t>(got);
+        }
+    }
+}
+
+void moveFile(const std::string& source, const std::string& target) {
+    std::error_code ec;
+    std::filesystem::rename(source, target, ec);
+    if (!ec) {
+        return;
+    }
+    if (ec != std::errc::cross_device_link) {
+        throw std::filesystem::filesystem_error("移动文件失败", source, target, ec);
+    }
+
+    FileDescriptor created(target, O_WRONLY | O_CREAT | O_TRUNC);
+    appendFileRange(source, 0, std::filesystem::file_size(source), target);
+    std::filesystem::remove(source);
+}
+
+void preallocateFile(const std::string& path, uint64_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    FileDescriptor file(path, O_WRONLY);
+    // 预留失败（不支持或空间不足）不影响正确性，写入时再按需分配
+    ::fallocate(file.fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(bytes));
+}
+
+void trimPreallocation(const std::string& path) {
+    FileDescriptor file(path, O_WRONLY);
+    struct stat st;
+    if (::fstat(file.fd, &st) != 0) {
+        throw std::runtime_error("无法获取文件大小: " + path);
+    }
+    // 截断到当前大小会释放文件末尾之后的数据块
+    if (::ftruncate(file.fd, st.st_size) != 0) {
+        throw std::runtime_error("截断文件失败: " + path + "，" + std::strerror(errno));
+    }
+}
@@ -0,0 +1,123 @@
+#include "small_task.h"
+#include <mutex>
+#include <cstddef>
+
+namespace {
+
+// 每个块前的头部，记录分配该块的线程的本地缓存，对齐到max_align_t以保证返回地址的对齐
+constexpr size_t kHeaderBytes = alignof(std::max_align_t);
+constexpr size_t kClassCount =
+    (BlockPool::kMaxBlockSize + kHeaderBytes + BlockPool::kGranularity - 1) / BlockPool::kGranularity;
+constexpr size_t kLocalCacheLimit = 256;   // 每个线程每个分级最多缓存的空闲块数
+constexpr size_t kTransferBatch = 64;      // 本地缓存与全局链表之间一次交换的块数
+
+// 空闲块内嵌的链表节点
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// 已分配块的头部，owner只用于比较身份，不会被解引用，分配线程退出后仍可安全比较
+struct BlockHeader {
+    const void* owner;
+};
+
+struct FreeList {
+    FreeBlock* head = nullptr;
+    size_t count = 0;
+
+    void push(FreeBlock* block) {
+        block->next = head;
+        head = block;
+        ++count;
+    }
+
+    FreeBlock* pop() {
+        FreeBlock* block = head;
+        head = block->next;
+        --count;
+        return block;
+    }
+};
+
+// 所有线程共享的空闲链表，只在本地缓存为空或溢出时访问
+struct GlobalLists {
+    std::mutex mutex;
+    FreeList lists[kClassCount];
+};
+
+GlobalLists& globalLists() {
+    static GlobalLists* lists = new GlobalLists();   // 有意不析构，线程退出时仍可安全归还
+    return *lists;
+}
+
+// 线程本地缓存，只缓存本线程分配的块；线程退出时把空闲块归还给全局链表
+struct LocalCache {
+    FreeList lists[kClassCount];
+
+    ~LocalCache() {
+        GlobalLists& global = globalLists();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        for (size_t i = 0; i < kClassCount; ++i) {
+            while (lists[i].head) {
+                global.lists[i].push(lists[i].pop());
+            }
+        }
+    }
+};
+
+thread_local LocalCache local_cache;
+
+// 含头部的块所在的分级
+size_t sizeClass(size_t bytes) {
+    return (bytes + kHeaderBytes + BlockPool::kGranularity - 1) / BlockPool::kGranularity - 1;
+}
+
+} // namespace
+
+void* BlockPool::allocate(size_t bytes) {
+    if (bytes == 0 || bytes > kMaxBlockSize) {
+        return ::operator new(bytes);
+    }
+
+    size_t index = sizeClass(bytes);
+    FreeList& local = local_cache.lists[index];
+    if (!local.head) {
+        // 本地缓存为空，从全局链表批量取回
+        GlobalLists& global = globalLists();
+        std::lock_guard<std::mutex> lock(global.mutex);
+        for (size_t i = 0; i < kTransferBatch && global.lists[index].head; ++i) {
+            local.push(global.lists[index].pop());
+        }
+    }
+    void* block = local.head ? static_cast<void*>(local.pop()) : ::operator new((index + 1) * kGranularity);
+    static_cast<BlockHeader*>(block)->owner = &local_cache;
+    return static_cast<char*>(block) + kHeaderBytes;
+}
+
+void BlockPool::deallocate(void* ptr, size_t bytes) {
+    if (bytes == 0 || bytes > kMaxBlockSize) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    size_t index = sizeClass(bytes);
+    void* block = static_cast<char*>(ptr) - kHeaderBytes;
+    GlobalLists& global = globalLists();
+    if (static_cast<BlockHeader*>(block)->owner != &local_cache) {
+        // 其他线程分配的块直接归还全局链表，分配线程的本地缓存为空时即可取回，
+        // 不会滞留在只释放不分配的线程的本地缓存中
+        std::lock_guard<std::mutex> lock(global.mutex);
+        global.lists[index].push(static_cast<FreeBlock*>(block));
+        return;
+    }
+
+    FreeList& local = local_cache.lists[index];
+    local.push(static_cast<FreeBlock*>(block));
+    if (local.count > kLocalCacheLimit) {
+        // 本地缓存过多，批量归还全局链表
+        std::lock_guard<std::mutex> lock(global.mutex);
+        for (size_t i = 0; i < kTransferBatch; ++i) {
+            global.lists[index].push(local.pop());
+        }
+    }
+}
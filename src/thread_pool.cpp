@@ -1,43 +1,356 @@
 #include "thread_pool.h"
 #include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <cmath>
+#include <sched.h>
+
+namespace {
+
+// 耗时（纳秒）所在的对数直方图桶
+size_t histogramBucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (us > 1 && bucket + 1 < ThreadPoolStats::kHistogramBuckets) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+// 解析cgroup v2的cpu.max（"<quota> <period>"或"max <period>"），返回配额允许的CPU数，无限制时返回0
+size_t readCgroupV2Quota(const std::string& path) {
+    std::ifstream file(path);
+    std::string quota;
+    double period = 0;
+    if (!(file >> quota >> period) || quota == "max" || period <= 0) {
+        return 0;
+    }
+    return static_cast<size_t>(std::ceil(std::stod(quota) / period));
+}
+
+// 解析cgroup v1的cpu.cfs_quota_us与cpu.cfs_period_us，配额为-1表示无限制，此时返回0
+size_t readCgroupV1Quota(const std::string& dir) {
+    std::ifstream quota_file(dir + "/cpu.cfs_quota_us");
+    std::ifstream period_file(dir + "/cpu.cfs_period_us");
+    double quota = -1, period = 0;
+    if (!(quota_file >> quota) || !(period_file >> period) || quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return static_cast<size_t>(std::ceil(quota / period));
+}
+
+// 从cgroup目录root + path起逐级向上直到root本身，取各级配额中的最小值（子cgroup受所有祖先的限制），均未设置时返回0
+template<typename ReadQuota>
+size_t minAncestorQuota(const std::string& root, std::string path, ReadQuota read_quota) {
+    size_t result = 0;
+    while (true) {
+        size_t quota = read_quota(root + path);
+        if (quota > 0 && (result == 0 || quota < result)) {
+            result = quota;
+        }
+        if (path.empty() || path == "/") {
+            return result;
+        }
+        size_t slash = path.find_last_of('/');
+        path.resize(slash == std::string::npos ? 0 : slash);
+    }
+}
+
+// 取当前进程所属cgroup的CPU配额，优先cgroup v2，其次v1，未设置配额时返回0
+size_t cgroupCpuQuota() {
+    std::ifstream cgroup_file("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroup_file, line)) {
+        // 每行格式为 "层级ID:控制器列表:路径"
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+
+        if (controllers.empty()) {
+            // cgroup v2统一层级，容器内通常挂载为/sys/fs/cgroup本身
+            size_t quota = minAncestorQuota("/sys/fs/cgroup", path, [](const std::string& dir) {
+                return readCgroupV2Quota(dir + "/cpu.max");
+            });
+            if (quota > 0) {
+                return quota;
+            }
+        } else if (controllers.find("cpu") != std::string::npos &&
+                   controllers.find("cpuset") == std::string::npos) {
+            for (const std::string& root : {std::string("/sys/fs/cgroup/cpu,cpuacct"), std::string("/sys/fs/cgroup/cpu")}) {
+                size_t quota = minAncestorQuota(root, path, readCgroupV1Quota);
+                if (quota > 0) {
+                    return quota;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+size_t ThreadPool::detectCpuCount() {
+    size_t count = std::thread::hardware_concurrency();
+
+    // 调度亲和性限制（taskset、cpuset）
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+        size_t affinity = CPU_COUNT(&cpu_set);
+        if (affinity > 0 && (count == 0 || affinity < count)) {
+            count = affinity;
+        }
+    }
+
+    // cgroup CPU配额（docker --cpus、k8s limits）
+    size_t quota = cgroupCpuQuota();
+    if (quota > 0 && (count == 0 || quota < count)) {
+        count = quota;
+    }
+
+    return std::max<size_t>(count, 1);
+}
 
 ThreadPool::ThreadPool(size_t num_threads) : stop_(false) {
     // 创建工作线程，每个线程运行一个循环，不断从任务队列中取任务执行
-    for (size_t i = 0; i < num_threads; ++i) {
-        workers_.emplace_back([this] {
-            while (true) {
-                std::function<void()> task;
-                
-                {
-                    // 使用作用域锁保护任务队列，退出作用域时自动解锁
-                    std::unique_lock<std::mutex> lock(this->queue_mutex_); 
-
-                    // 条件变量，线程阻塞，直到任务队列非空或者线程池停止，阻塞时释放锁，唤醒时重新获取锁
-                    this->condition_.wait(lock, [this] { 
-                        return this->stop_ || !this->tasks_.empty(); 
-                    });
-
-                    // 线程池停止且任务队列为空，退出线程
-                    if (this->stop_ && this->tasks_.empty()) {
-                        return;
-                    }
-                    
-                    task = std::move(this->tasks_.front());   // 移动语义避免不必要的拷贝开销
-                    this->tasks_.pop();   // 从队列中弹出任务
-                }
-                
-                task();   // 执行任务
+    resize(num_threads == 0 ? detectCpuCount() : num_threads);
+}
+
+void ThreadPool::resize(size_t num_threads) {
+    num_threads = std::max<size_t>(num_threads, 1);
+    std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+
+    size_t current = workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        active_threads_ = num_threads;
+    }
+
+    if (num_threads < current) {
+        // 缩容：唤醒所有线程，序号超出目标的线程执行完当前任务后退出
+        condition_.notify_all();
+        for (size_t i = num_threads; i < current; ++i) {
+            workers_[i].join();
+            retireCounters(*worker_counters_[i]);
+        }
+        workers_.resize(num_threads);
+        return;
+    }
+
+    // 扩容：复用之前的统计计数器，创建新线程
+    for (size_t i = current; i < num_threads; ++i) {
+        if (i >= worker_counters_.size()) {
+            worker_counters_.push_back(std::make_unique<WorkerCounters>());
+        }
+        workers_.emplace_back(&ThreadPool::workerLoop, this, i, std::ref(*worker_counters_[i]));
+    }
+}
+
+void ThreadPool::post(SmallTask task) {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);  // 加锁保护任务队列，退出作用域时自动解锁
+
+        // 防止在停止后提交任务
+        if (stop_) {
+            throw std::runtime_error("submit on stopped ThreadPool");
+        }
+
+        tasks_.push({std::move(task), Clock::now()});
+        ++tasks_submitted_;
+        max_queue_depth_ = std::max(max_queue_depth_, tasks_.size());
+    }
+
+    // 唤醒一个等待线程
+    condition_.notify_one();
+}
+
+size_t ThreadPool::size() const {
+    std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+    return workers_.size();
+}
+
+void ThreadPool::workerLoop(size_t index, WorkerCounters& counters) {
+    auto idle_since = Clock::now();
+    while (true) {
+        QueuedTask task;
+        
+        {
+            // 使用作用域锁保护任务队列，退出作用域时自动解锁
+            std::unique_lock<std::mutex> lock(this->queue_mutex_); 
+
+            // 条件变量，线程阻塞，直到任务队列非空、线程池停止或本线程被缩容移除，阻塞时释放锁，唤醒时重新获取锁
+            this->condition_.wait(lock, [this, index] { 
+                return this->stop_ || index >= this->active_threads_ || !this->tasks_.empty(); 
+            });
+
+            // 本线程被缩容移除，剩余任务由其他线程执行
+            if (index >= this->active_threads_) {
+                return;
             }
-        });
+
+            // 线程池停止且任务队列为空，退出线程
+            if (this->stop_ && this->tasks_.empty()) {
+                return;
+            }
+            
+            task = std::move(this->tasks_.front());   // 移动语义避免不必要的拷贝开销
+            this->tasks_.pop();   // 从队列中弹出任务
+        }
+        
+        auto start = Clock::now();
+        uint64_t wait_ns = elapsedNs(task.enqueue_time, start);
+        counters.idle_ns.fetch_add(elapsedNs(idle_since, start), std::memory_order_relaxed);
+        counters.queue_wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+        counters.queue_wait_histogram[histogramBucket(wait_ns)].fetch_add(1, std::memory_order_relaxed);
+
+        running_task_ = {&counters, start};
+        task.fn();   // 执行任务
+        completeRunningTask();   // post提交的任务没有promise，在这里记录
+        idle_since = Clock::now();
+    }
+}
+
+thread_local ThreadPool::RunningTask ThreadPool::running_task_;
+
+void ThreadPool::completeRunningTask() {
+    RunningTask& running = running_task_;
+    if (!running.counters) {
+        return;
+    }
+    uint64_t run_ns = elapsedNs(running.start, Clock::now());
+    running.counters->busy_ns.fetch_add(run_ns, std::memory_order_relaxed);
+    running.counters->run_time_histogram[histogramBucket(run_ns)].fetch_add(1, std::memory_order_relaxed);
+    running.counters->tasks.fetch_add(1, std::memory_order_relaxed);
+    running.counters = nullptr;
+}
+
+void ThreadPool::retireCounters(WorkerCounters& counters) {
+    retired_.tasks += counters.tasks.exchange(0, std::memory_order_relaxed);
+    retired_.busy_ns += counters.busy_ns.exchange(0, std::memory_order_relaxed);
+    retired_.queue_wait_ns += counters.queue_wait_ns.exchange(0, std::memory_order_relaxed);
+    counters.idle_ns.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < ThreadPoolStats::kHistogramBuckets; ++i) {
+        retired_.queue_wait_histogram[i] += counters.queue_wait_histogram[i].exchange(0, std::memory_order_relaxed);
+        retired_.run_time_histogram[i] += counters.run_time_histogram[i].exchange(0, std::memory_order_relaxed);
     }
 }
 
 ThreadPool::~ThreadPool() {
-    stop_ = true;   // 停止所有工作线程
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stop_ = true;   // 停止所有工作线程
+    }
     condition_.notify_all();   // 唤醒所有等待线程
     
     // 等待所有工作线程结束
+    std::lock_guard<std::mutex> workers_lock(workers_mutex_);
     for (std::thread &worker : workers_) {
         worker.join();
     }
-}
\ No newline at end of file
+}
+
+ThreadPoolStats ThreadPool::stats() const {
+    ThreadPoolStats result;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        result.tasks_submitted = tasks_submitted_;
+        result.queue_depth = tasks_.size();
+        result.max_queue_depth = max_queue_depth_;
+    }
+
+    std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+    // 已移除的线程不再出现在workers中，但它们执行过的任务仍计入总数和直方图
+    result.tasks_completed = retired_.tasks;
+    result.total_run_us = retired_.busy_ns / 1000;
+    result.total_queue_wait_us = retired_.queue_wait_ns / 1000;
+    result.queue_wait_histogram = retired_.queue_wait_histogram;
+    result.run_time_histogram = retired_.run_time_histogram;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        const auto& counters = worker_counters_[i];
+        ThreadPoolStats::Worker worker;
+        worker.tasks = counters->tasks.load(std::memory_order_relaxed);
+        worker.busy_us = counters->busy_ns.load(std::memory_order_relaxed) / 1000;
+        worker.idle_us = counters->idle_ns.load(std::memory_order_relaxed) / 1000;
+        result.tasks_completed += worker.tasks;
+        result.total_run_us += worker.busy_us;
+        result.total_queue_wait_us += counters->queue_wait_ns.load(std::memory_order_relaxed) / 1000;
+        for (size_t i = 0; i < ThreadPoolStats::kHistogramBuckets; ++i) {
+            result.queue_wait_histogram[i] += counters->queue_wait_histogram[i].load(std::memory_order_relaxed);
+            result.run_time_histogram[i] += counters->run_time_histogram[i].load(std::memory_order_relaxed);
+        }
+        result.workers.push_back(worker);
+    }
+    return result;
+}
+
+void ThreadPool::resetStats() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        tasks_submitted_ = 0;
+        max_queue_depth_ = tasks_.size();
+    }
+
+    // 工作线程可能正在累加，清零与累加之间的竞争只会让个别样本计入上一个周期
+    std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+    retired_ = RetiredCounters();
+    for (auto& counters : worker_counters_) {
+        counters->tasks.store(0, std::memory_order_relaxed);
+        counters->busy_ns.store(0, std::memory_order_relaxed);
+        counters->idle_ns.store(0, std::memory_order_relaxed);
+        counters->queue_wait_ns.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < ThreadPoolStats::kHistogramBuckets; ++i) {
+            counters->queue_wait_histogram[i].store(0, std::memory_order_relaxed);
+            counters->run_time_histogram[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t ThreadPoolStats::percentileUs(const Histogram& histogram, double p) {
+    uint64_t total = 0;
+    for (uint64_t count : histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(p * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kHistogramBuckets; ++i) {
+        seen += histogram[i];
+        if (seen > target) {
+            return uint64_t(1) << (i + 1);
+        }
+    }
+    return uint64_t(1) << kHistogramBuckets;
+}
+
+std::string ThreadPoolStats::toString() const {
+    std::ostringstream out;
+    uint64_t completed = std::max<uint64_t>(tasks_completed, 1);
+    out << "提交任务: " << tasks_submitted << "，完成任务: " << tasks_completed
+        << "，当前队列长度: " << queue_depth << "，最大队列长度: " << max_queue_depth << "\n";
+    out << "排队等待: 平均 " << total_queue_wait_us / completed << "us，p50 <= "
+        << percentileUs(queue_wait_histogram, 0.5) << "us，p99 <= "
+        << percentileUs(queue_wait_histogram, 0.99) << "us\n";
+    out << "任务执行: 平均 " << total_run_us / completed << "us，p50 <= "
+        << percentileUs(run_time_histogram, 0.5) << "us，p99 <= "
+        << percentileUs(run_time_histogram, 0.99) << "us\n";
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const auto& worker = workers[i];
+        uint64_t total_us = std::max<uint64_t>(worker.busy_us + worker.idle_us, 1);
+        out << "  线程" << i << ": 任务 " << worker.tasks << "，忙碌 " << worker.busy_us / 1000
+            << "ms，空闲 " << worker.idle_us / 1000 << "ms，利用率 "
+            << (worker.busy_us * 100 / total_us) << "%\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,282 @@
+#include "varlen_sort.h"
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <queue>
+
+namespace fs = std::filesystem;
+
+void VarLenFormat::append(std::string& out, std::string_view key, std::string_view value) {
+    uint32_t lengths[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+    out.append(reinterpret_cast<const char*>(lengths), sizeof(lengths));
+    out.append(key);
+    out.append(value);
+}
+
+size_t VarLenFormat::parse(const char* data, size_t size, VarLenRecord& record) {
+    if (size < kRecordHeaderBytes) {
+        return 0;
+    }
+    uint32_t lengths[2];
+    std::memcpy(lengths, data, sizeof(lengths));
+    size_t total = kRecordHeaderBytes + size_t(lengths[0]) + lengths[1];
+    if (size < total) {
+        return 0;
+    }
+    record.key = std::string_view(data + kRecordHeaderBytes, lengths[0]);
+    record.value = std::string_view(data + kRecordHeaderBytes + lengths[0], lengths[1]);
+    return total;
+}
+
+uint64_t VarLenFormat::keyPrefix(std::string_view key) {
+    uint64_t prefix = 0;
+    size_t n = std::min(key.size(), sizeof(prefix));
+    for (size_t i = 0; i < n; ++i) {
+        prefix |= uint64_t(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+VarLenRunReader::VarLenRunReader(const std::string& path, ThreadPool& io_pool, size_t block_bytes)
+    : path_(path), reader_(path, io_pool, block_bytes) {}
+
+bool VarLenRunReader::loadFrame() {
+    while (true) {
+        size_t available = pending_.size() - pending_pos_;
+        if (available >= VarLenFormat::kFrameHeaderBytes) {
+            uint32_t payload;
+            std::memcpy(&payload, pending_.data() + pending_pos_, sizeof(payload));
+            size_t frame_size = VarLenFormat::kFrameHeaderBytes + payload;
+            if (available >= frame_size) {
+                frame_end_ = pending_pos_ + frame_size;
+                pending_pos_ += VarLenFormat::kFrameHeaderBytes;
+                return true;
+            }
+        }
+
+        // 帧不完整：丢弃已消费的字节，再读入下一个块，帧可能跨越多个块
+        pending_.erase(pending_.begin(), pending_.begin() + pending_pos_);
+        pending_pos_ = 0;
+        if (!reader_.read(block_)) {
+            if (!pending_.empty()) {
+                throw std::runtime_error("变长记录文件不完整: " + path_);
+            }
+            return false;
+        }
+        pending_.insert(pending_.end(), block_.begin(), block_.end());
+    }
+}
+
+bool VarLenRunReader::next(VarLenRecord& record) {
+    // 当前帧已读完，加载下一个非空帧
+    while (pending_pos_ >= frame_end_) {
+        pending_pos_ = frame_end_;
+        if (!loadFrame()) {
+            return false;
+        }
+    }
+
+    size_t used = VarLenFormat::parse(pending_.data() + pending_pos_, frame_end_ - pending_pos_, record);
+    if (used == 0) {
+        throw std::runtime_error("变长记录帧损坏: " + path_);
+    }
+    pending_pos_ += used;
+    return true;
+}
+
+void VarLenRunReader::close() {
+    reader_.close();
+}
+
+VarLenRunWriter::VarLenRunWriter(const std::string& path, ThreadPool& io_pool, size_t frame_bytes,
+                                 uint64_t expected_bytes)
+    : writer_(path, io_pool, expected_bytes), frame_bytes_(frame_bytes) {
+    frame_.resize(VarLenFormat::kFrameHeaderBytes);
+}
+
+void VarLenRunWriter::write(const VarLenRecord& record) {
+    uint32_t lengths[2] = {static_cast<uint32_t>(record.key.size()), static_cast<uint32_t>(record.value.size())};
+    const char* header = reinterpret_cast<const char*>(lengths);
+    frame_.insert(frame_.end(), header, header + sizeof(lengths));
+    frame_.insert(frame_.end(), record.key.begin(), record.key.end());
+    frame_.insert(frame_.end(), record.value.begin(), record.value.end());
+    ++frame_records_;
+
+    // 帧只包含完整记录，超长记录单独成帧
+    if (frame_.size() >= frame_bytes_) {
+        flushFrame();
+    }
+}
+
+void VarLenRunWriter::flushFrame() {
+    if (frame_records_ == 0) {
+        return;
+    }
+    uint32_t header[2] = {static_cast<uint32_t>(frame_.size() - VarLenFormat::kFrameHeaderBytes), frame_records_};
+    std::memcpy(frame_.data(), header, sizeof(header));
+    writer_.write(frame_);   // frame_被替换为空闲缓冲区
+    frame_.resize(VarLenFormat::kFrameHeaderBytes);
+    frame_records_ = 0;
+}
+
+void VarLenRunWriter::close() {
+    flushFrame();
+    writer_.close();
+}
+
+void VarLenExternalMergeSorter::writeSortedRun(const std::vector<char>& arena,
+                                               std::vector<std::pair<uint64_t, uint32_t>>& entries,
+                                               const std::string& filename) {
+    auto keyAt = [&arena](uint32_t offset) {
+        uint32_t key_length;
+        std::memcpy(&key_length, arena.data() + offset, sizeof(key_length));
+        return std::string_view(arena.data() + offset + VarLenFormat::kRecordHeaderBytes, key_length);
+    };
+
+    // 前缀不同即可决定顺序，只有前缀相同才访问键本身
+    std::sort(entries.begin(), entries.end(), [&keyAt](const auto& a, const auto& b) {
+        if (a.first != b.first) {
+            return a.first < b.first;
+        }
+        return VarLenFormat::keyLess(keyAt(a.second), keyAt(b.second));
+    });
+
+    VarLenRunWriter writer(filename, pool(Stage::Write), kFrameBytes, arena.size());
+    VarLenRecord record;
+    for (const auto& entry : entries) {
+        VarLenFormat::parse(arena.data() + entry.second, arena.size() - entry.second, record);
+        writer.write(record);
+    }
+    writer.close();
+}
+
+ExternalMergeSorterBase::ChunkInfo VarLenExternalMergeSorter::processFile(const std::string& filepath) {
+    // 内存限制：一半用于存放记录的arena，其余留给预读块和排序项
+    const size_t thread_memory = memory_limit_ / (num_threads_ > 0 ? num_threads_ : 1);
+    const size_t arena_limit = std::max(thread_memory / 2, static_cast<size_t>(4096));
+    const size_t read_bytes = std::max(thread_memory / 8, static_cast<size_t>(4096));
+
+    BlockReader<char> input(filepath, pool(Stage::Read), read_bytes);
+
+    ChunkInfo info;
+    info.data_count = 0;
+
+    std::vector<std::string> chunk_files;
+    std::vector<char> arena;      // 当前批次的记录原始字节
+    std::vector<char> block;
+    std::vector<std::pair<uint64_t, uint32_t>> entries;   // (键前缀, 记录在arena中的偏移)
+    size_t parsed = 0;            // arena中已解析为完整记录的字节数
+
+    auto flushRun = [&]() {
+        std::string chunk_filename = tempPath(filepath + ".sorted.chunk" + std::to_string(chunk_files.size()), parsed);
+        chunk_files.push_back(chunk_filename);
+        writeSortedRun(arena, entries, chunk_filename);
+
+        // 未解析完的尾部记录移到arena开头，留给下一批
+        arena.erase(arena.begin(), arena.begin() + parsed);
+        parsed = 0;
+        entries.clear();
+    };
+
+    while (input.read(block)) {
+        arena.insert(arena.end(), block.begin(), block.end());
+        if (arena.size() > UINT32_MAX) {
+            throw std::runtime_error("变长记录批次超出32位偏移范围: " + filepath);
+        }
+
+        VarLenRecord record;
+        while (size_t used = VarLenFormat::parse(arena.data() + parsed, arena.size() - parsed, record)) {
+            entries.emplace_back(VarLenFormat::keyPrefix(record.key), static_cast<uint32_t>(parsed));
+            parsed += used;
+            info.data_count++;
+        }
+
+        if (arena.size() >= arena_limit && !entries.empty()) {
+            flushRun();
+        }
+    }
+    input.close();
+
+    if (parsed != arena.size()) {
+        throw std::runtime_error("变长记录文件不完整: " + filepath);
+    }
+    if (!entries.empty() || chunk_files.empty()) {
+        flushRun();
+    }
+
+    // 只有一个chunk时它就是这个文件的run，否则归并成一个run
+    if (chunk_files.size() == 1) {
+        info.temp_file = chunk_files[0];
+    } else {
+        info.temp_file = tempPath(filepath + ".sorted", fs::file_size(filepath));
+        mergeFiles(chunk_files, info.temp_file);
+        releaseTemp(chunk_files);
+    }
+    return info;
+}
+
+void VarLenExternalMergeSorter::mergeFiles(const std::vector<std::string>& files, const std::string& output_file) {
+    if (files.empty()) {
+        return;
+    }
+
+    if (files.size() == 1) {
+        // run与输出格式相同，直接移动为输出文件（跨文件系统时由内核复制）
+        moveFile(files[0], output_file);
+        return;
+    }
+
+    // 每个输入流同时持有正在归并的块和后台预读的块
+    const size_t block_bytes = std::max(memory_limit_ / files.size() / (num_threads_ > 0 ? num_threads_ : 1) / 2,
+                                        static_cast<size_t>(4096));
+    std::vector<std::unique_ptr<VarLenRunReader>> inputs(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        inputs[i] = std::make_unique<VarLenRunReader>(files[i], pool(Stage::Read), block_bytes);
+    }
+
+    VarLenRunWriter output(output_file, pool(Stage::Write), kFrameBytes, totalFileBytes(files));
+
+    // 堆节点缓存键前缀，前缀不同时无需访问键本身
+    struct Element {
+        uint64_t prefix;
+        VarLenRecord record;
+        size_t stream_index;
+    };
+
+    struct ElementGreater {
+        bool operator()(const Element& a, const Element& b) const {
+            if (a.prefix != b.prefix) {
+                return a.prefix > b.prefix;
+            }
+            return VarLenFormat::keyLess(b.record.key, a.record.key);
+        }
+    };
+
+    std::priority_queue<Element, std::vector<Element>, ElementGreater> min_heap;
+
+    auto pushNext = [&](size_t index) {
+        VarLenRecord record;
+        if (inputs[index]->next(record)) {
+            min_heap.push({VarLenFormat::keyPrefix(record.key), record, index});
+        } else {
+            // 文件已读完，关闭流并删除中间顺序文件
+            inputs[index]->close();
+            fs::remove(files[index]);
+        }
+    };
+
+    for (size_t index = 0; index < files.size(); ++index) {
+        pushNext(index);
+    }
+
+    while (!min_heap.empty()) {
+        Element elem = min_heap.top();
+        min_heap.pop();
+
+        // 先写出记录，再推进该输入流（推进可能使记录视图失效）
+        output.write(elem.record);
+        pushNext(elem.stream_index);
+    }
+
+    output.close();
+}
@@ -2,14 +2,37 @@
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <map>
 #include <filesystem>
 #include <chrono>
+#include <numeric>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include "../include/external_merge_sort.h"
+#include "../include/varlen_sort.h"
 #include "../src/generate_data.cpp"
 
 namespace fs = std::filesystem;
 
+// 统计堆分配次数，用于验证线程池提交路径不分配内存
+static std::atomic<size_t> g_heap_allocations{0};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
 class ExternalMergeSortTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -100,6 +123,23 @@ protected:
         return file_size / sizeof(int64_t);
     }
 
+    // 写入任意定长记录
+    template<typename T>
+    void write_records(const std::string& filename, const std::vector<T>& records) {
+        std::ofstream file(filename, std::ios::binary);
+        ASSERT_TRUE(file.is_open());
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+    }
+
+    // 读出文件中的全部定长记录
+    template<typename T>
+    std::vector<T> read_records(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        std::vector<T> records(count_file_elements(filename) * sizeof(int64_t) / sizeof(T));
+        file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(T));
+        return records;
+    }
+
     // 获取当前内存使用情况（以MB为单位）
     double get_memory_usage_mb() {
         struct rusage usage;
@@ -274,4 +314,1619 @@ TEST_F(ExternalMergeSortTest, LargeRandomDataset) {
     // 验证元素总数一致
     size_t output_elements = count_file_elements(output_file);
     EXPECT_EQ(total_elements, output_elements);
-}
\ No newline at end of file
+}
+
+// 测试大小差异悬殊的文件（按大小降序调度）
+TEST_F(ExternalMergeSortTest, MixedFileSizes) {
+    const size_t SIZES[] = {100, 50000, 1000, 20, 8000, 300000, 5};
+
+    std::cout << "\n=== 测试混合文件大小 ===" << std::endl;
+
+    size_t total_input_elements = 0;
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i) {
+        std::string filename = test_dir + "/mixed_" + std::to_string(i) + ".dat";
+        generate_test_file(filename, SIZES[i]);
+        total_input_elements += SIZES[i];
+    }
+
+    ExternalMergeSorter sorter(test_dir, output_file, 1024 * 1024, 4);
+    sorter.sort();
+
+    ASSERT_TRUE(fs::exists(output_file));
+    EXPECT_TRUE(is_file_sorted(output_file));
+    EXPECT_EQ(total_input_elements, count_file_elements(output_file));
+
+    // 只有一个计算线程时处理顺序即提交顺序，应按文件大小降序（最长任务优先）
+    class RecordingSorter : public ExternalMergeSorter<int64_t> {
+    public:
+        using ExternalMergeSorter<int64_t>::ExternalMergeSorter;
+        std::vector<std::string> order;
+
+    protected:
+        ChunkInfo processFile(const std::string& filepath) override {
+            order.push_back(filepath);
+            return ExternalMergeSorter<int64_t>::processFile(filepath);
+        }
+    };
+
+    RecordingSorter recording(test_dir, output_file, 1024 * 1024, 1);
+    recording.sort();
+    EXPECT_TRUE(is_file_sorted(output_file));
+
+    std::vector<size_t> indices(sizeof(SIZES) / sizeof(SIZES[0]));
+    std::iota(indices.begin(), indices.end(), 0);
+    std::sort(indices.begin(), indices.end(), [&](size_t a, size_t b) { return SIZES[a] > SIZES[b]; });
+    ASSERT_EQ(indices.size(), recording.order.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        EXPECT_EQ(fs::path(test_dir + "/mixed_" + std::to_string(indices[i]) + ".dat"), fs::path(recording.order[i]));
+    }
+}
+
+// 测试线程池运行时统计
+TEST(ThreadPoolTest, RuntimeStats) {
+    const size_t TASKS = 64;
+    ThreadPool pool(4);
+
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < TASKS; ++i) {
+        futures.push_back(pool.submit([] {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    // 任务在发布结果之前已计入统计，future就绪后统计即完整
+    ThreadPoolStats stats = pool.stats();
+    std::cout << stats.toString();
+    EXPECT_EQ(TASKS, stats.tasks_submitted);
+    EXPECT_EQ(TASKS, stats.tasks_completed);
+    EXPECT_EQ(0u, stats.queue_depth);
+    EXPECT_GE(stats.max_queue_depth, 1u);
+    ASSERT_EQ(4u, stats.workers.size());
+
+    uint64_t histogram_total = 0;
+    for (uint64_t count : stats.run_time_histogram) {
+        histogram_total += count;
+    }
+    EXPECT_EQ(TASKS, histogram_total);
+    EXPECT_GE(ThreadPoolStats::percentileUs(stats.run_time_histogram, 0.5), 200u);
+
+    pool.resetStats();
+    EXPECT_EQ(0u, pool.stats().tasks_completed);
+}
+
+// 测试线程池运行时伸缩
+TEST(ThreadPoolTest, Resize) {
+    EXPECT_GE(ThreadPool::detectCpuCount(), 1u);
+
+    ThreadPool pool(2);
+    EXPECT_EQ(2u, pool.size());
+
+    std::atomic<size_t> done{0};
+    auto run_tasks = [&](size_t count) {
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < count; ++i) {
+            futures.push_back(pool.submit([&done] { done++; }));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    };
+
+    // 直方图中的任务总数
+    auto histogram_total = [](const ThreadPoolStats::Histogram& histogram) {
+        uint64_t total = 0;
+        for (uint64_t count : histogram) {
+            total += count;
+        }
+        return total;
+    };
+
+    pool.resize(6);
+    EXPECT_EQ(6u, pool.size());
+    run_tasks(100);
+    ThreadPoolStats before_shrink = pool.stats();
+    EXPECT_EQ(100u, before_shrink.tasks_completed);
+
+    // 缩容后被移除线程的统计仍计入累计值，不会减少
+    pool.resize(1);
+    EXPECT_EQ(1u, pool.size());
+    ThreadPoolStats after_shrink = pool.stats();
+    EXPECT_EQ(1u, after_shrink.workers.size());
+    EXPECT_EQ(before_shrink.tasks_completed, after_shrink.tasks_completed);
+    EXPECT_GE(after_shrink.total_run_us, before_shrink.total_run_us);
+    EXPECT_GE(after_shrink.total_queue_wait_us, before_shrink.total_queue_wait_us);
+    EXPECT_EQ(100u, histogram_total(after_shrink.run_time_histogram));
+    EXPECT_EQ(100u, histogram_total(after_shrink.queue_wait_histogram));
+    run_tasks(100);
+    EXPECT_EQ(200u, pool.stats().tasks_completed);
+
+    // 扩容复用计数器时不重复计入
+    pool.resize(3);
+    EXPECT_EQ(3u, pool.size());
+    EXPECT_EQ(200u, pool.stats().tasks_completed);
+    run_tasks(100);
+    EXPECT_EQ(300u, pool.stats().tasks_completed);
+    EXPECT_EQ(300u, histogram_total(pool.stats().run_time_histogram));
+
+    EXPECT_EQ(300u, done.load());
+}
+
+// 测试小任务提交路径不分配堆内存
+TEST(ThreadPoolTest, SubmitWithoutHeapAllocation) {
+    const size_t TASKS = 1000;
+    ThreadPool pool(2);
+    std::atomic<size_t> sum{0};
+    std::vector<std::future<void>> futures;
+    futures.reserve(2 * TASKS);
+
+    auto run_tasks = [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            futures.push_back(pool.submit([&sum, i] { sum += i; }));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+        futures.clear();
+    };
+
+    // 预热：让任务队列和future状态内存池达到稳定容量。预热提交两倍的任务，
+    // 即使工作线程在计数开始时还持有最后几个任务的共享状态，池中的空闲块也足够
+    run_tasks(2 * TASKS);
+
+    sum = 0;
+    size_t before = g_heap_allocations.load();
+    run_tasks(TASKS);
+    size_t allocations = g_heap_allocations.load() - before;
+
+    std::cout << "提交 " << TASKS << " 个任务的堆分配次数: " << allocations << std::endl;
+    EXPECT_EQ(0u, allocations);
+    EXPECT_EQ(TASKS * (TASKS - 1) / 2, sum.load());
+
+    // 返回值与异常仍能通过future传递
+    EXPECT_EQ(42, pool.submit([] { return 42; }).get());
+    EXPECT_THROW(pool.submit([] { throw std::runtime_error("error"); }).get(), std::runtime_error);
+}
+
+// 测试大量小文件（超过单轮归并路数，触发多轮分层归并）
+TEST_F(ExternalMergeSortTest, ManySmallFiles) {
+    const size_t FILE_COUNT = 300;
+    const size_t ELEMENTS_PER_FILE = 200;
+
+    std::cout << "\n=== 测试大量小文件 ===" << std::endl;
+
+    generate_multiple_test_files(FILE_COUNT, ELEMENTS_PER_FILE);
+
+    ExternalMergeSorter sorter(test_dir, output_file, 4 * 1024 * 1024, 4, 2);
+    sorter.sort();
+
+    ASSERT_TRUE(fs::exists(output_file));
+    EXPECT_TRUE(is_file_sorted(output_file));
+    EXPECT_EQ(FILE_COUNT * ELEMENTS_PER_FILE, count_file_elements(output_file));
+
+    // 中间归并轮次只有3组，计算线程池缩容到3；归并出错时也要恢复原来的线程数
+    class FailingMergeSorter : public ExternalMergeSorter<int64_t> {
+    public:
+        using ExternalMergeSorter::ExternalMergeSorter;
+        size_t computeThreads() const { return compute_pool_->size(); }
+        std::atomic<bool> fail{true};
+
+    protected:
+        Task<void> mergeFilesAsync(std::vector<std::string> files, std::string output) override {
+            if (fail.exchange(false)) {
+                throw std::runtime_error("模拟归并失败");
+            }
+            co_await ExternalMergeSorter::mergeFilesAsync(std::move(files), std::move(output));
+        }
+    };
+
+    fs::remove(output_file);
+    FailingMergeSorter failing(test_dir, output_file, 4 * 1024 * 1024, 4, 2);
+    EXPECT_THROW(failing.sort(), std::runtime_error);
+    EXPECT_EQ(4u, failing.computeThreads());
+
+    // 未设置临时目录时run写在输入文件旁边，重试前清理失败的排序留下的run
+    for (const auto& entry : fs::directory_iterator(test_dir)) {
+        if (entry.path().extension() != ".dat") {
+            fs::remove(entry.path());
+        }
+    }
+    failing.sort();
+    EXPECT_EQ(4u, failing.computeThreads());
+    EXPECT_TRUE(is_file_sorted(output_file));
+    EXPECT_EQ(FILE_COUNT * ELEMENTS_PER_FILE, count_file_elements(output_file));
+}
+
+// 测试计算/I/O执行器分离：预排序和归并在计算线程池上执行，预读和写出在I/O线程池上执行
+TEST_F(ExternalMergeSortTest, ExecutorSplit) {
+    const size_t FILE_COUNT = 200;
+    const size_t ELEMENTS_PER_FILE = 2000;
+
+    std::cout << "\n=== 测试执行器分离 ===" << std::endl;
+
+    generate_multiple_test_files(FILE_COUNT, ELEMENTS_PER_FILE);
+
+    // 分阶段执行排序，每个阶段开始时清零统计，结束后读取两个线程池的统计
+    class ExecutorSorter : public ExternalMergeSorter<int64_t> {
+    public:
+        using ExternalMergeSorter::ExternalMergeSorter;
+        void presort() {
+            resetPoolStats();
+            chunks_ = splitAndPresort();
+        }
+        void merge() {
+            resetPoolStats();
+            mergeChunks(chunks_);
+        }
+        ThreadPoolStats computeStats() const { return compute_pool_->stats(); }
+        ThreadPoolStats ioStats() const { return io_pool_->stats(); }
+        static bool computeOnCompute() {
+            return executorFor(Stage::Presort) == Executor::Compute && executorFor(Stage::Merge) == Executor::Compute;
+        }
+        static bool ioOnIo() {
+            return executorFor(Stage::Read) == Executor::IO && executorFor(Stage::Write) == Executor::IO;
+        }
+
+    private:
+        std::vector<ChunkInfo> chunks_;
+    };
+    EXPECT_TRUE(ExecutorSorter::computeOnCompute());
+    EXPECT_TRUE(ExecutorSorter::ioOnIo());
+
+    ExecutorSorter sorter(test_dir, output_file, 4 * 1024 * 1024, 2, 2);
+
+    // 每个输入文件是计算线程池上的一个任务；读取输入和写出run都在I/O线程池上，
+    // 最后一次预读可能在统计时仍未完成，只要求每个文件至少一个I/O任务
+    sorter.presort();
+    ThreadPoolStats compute = sorter.computeStats();
+    ThreadPoolStats io = sorter.ioStats();
+    std::cout << "预排序: 计算任务 " << compute.tasks_completed << "，I/O任务 " << io.tasks_completed << std::endl;
+    EXPECT_EQ(FILE_COUNT, compute.tasks_completed);
+    EXPECT_GE(io.tasks_completed, FILE_COUNT);
+
+    // run多于kMergeFactor，中间归并协程在计算线程池上运行，读取run和写出归并结果在I/O线程池上
+    sorter.merge();
+    compute = sorter.computeStats();
+    io = sorter.ioStats();
+    std::cout << "归并: 计算任务 " << compute.tasks_completed << "，I/O任务 " << io.tasks_completed << std::endl;
+    EXPECT_GT(compute.tasks_completed, 0u);
+    EXPECT_GE(io.tasks_completed, FILE_COUNT);
+
+    ASSERT_TRUE(fs::exists(output_file));
+    EXPECT_TRUE(is_file_sorted(output_file));
+    EXPECT_EQ(FILE_COUNT * ELEMENTS_PER_FILE, count_file_elements(output_file));
+}
+
+// 测试协程执行器：等待I/O的协程挂起而不占用计算线程，一个计算线程即可推进上百个输入流
+TEST_F(ExternalMergeSortTest, CoroutineExecutor) {
+    std::cout << "\n=== 测试协程执行器 ===" << std::endl;
+
+    ThreadPool compute_pool(1);
+    ThreadPool io_pool(2);
+
+    {
+        // I/O被阻塞时，唯一的计算线程仍能执行另一个协程
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        auto waitIo = [](ThreadPool& io, ThreadPool& executor, std::shared_future<void> opened) -> Task<int> {
+            AsyncResult<int> result = AsyncResult<int>::run(io, [opened] {
+                opened.wait();
+                return 42;
+            });
+            int value = co_await result.resumeOn(executor);
+            co_return value + 1;
+        };
+        auto compute = []() -> Task<int> {
+            co_return 7;
+        };
+
+        std::future<int> blocked = spawn(compute_pool, waitIo(io_pool, compute_pool, opened));
+        std::future<int> ready = spawn(compute_pool, compute());
+        ASSERT_EQ(std::future_status::ready, ready.wait_for(std::chrono::seconds(10)));
+        EXPECT_EQ(7, ready.get());
+        EXPECT_EQ(std::future_status::timeout, blocked.wait_for(std::chrono::milliseconds(0)));
+        gate.set_value();
+        EXPECT_EQ(43, blocked.get());
+    }
+
+    {
+        // I/O线程上的异常在co_await处重新抛出，最终由future交给调用方
+        auto failing = [](ThreadPool& io, ThreadPool& executor) -> Task<void> {
+            AsyncResult<int> result = AsyncResult<int>::run(io, []() -> int {
+                throw std::runtime_error("模拟读取失败");
+            });
+            co_await result.resumeOn(executor);
+        };
+        EXPECT_THROW(spawn(compute_pool, failing(io_pool, compute_pool)).get(), std::runtime_error);
+    }
+
+    {
+        // 200个文件由协程写出，再由一个计算线程轮流从每个文件读一块
+        const size_t FILE_COUNT = 200;
+        std::mt19937_64 gen(43);
+        std::vector<std::vector<int64_t>> contents(FILE_COUNT);
+        std::vector<std::string> files;
+        for (size_t i = 0; i < FILE_COUNT; ++i) {
+            contents[i].resize(500 + gen() % 500);
+            for (auto& value : contents[i]) {
+                value = static_cast<int64_t>(gen());
+            }
+            files.push_back(test_dir + "/file_" + std::to_string(i));
+        }
+
+        auto writeFile = [](std::string path, std::vector<int64_t> records, ThreadPool& io,
+                            ThreadPool& executor) -> Task<void> {
+            BlockWriter<int64_t> writer(path, io);
+            co_await writer.writeAsync(records, executor);
+            co_await writer.closeAsync(executor);
+        };
+        for (size_t i = 0; i < FILE_COUNT; ++i) {
+            spawn(compute_pool, writeFile(files[i], contents[i], io_pool, compute_pool)).get();
+        }
+
+        auto readFiles = [](std::vector<std::string> files, ThreadPool& io,
+                            ThreadPool& executor) -> Task<std::vector<std::vector<int64_t>>> {
+            std::vector<std::unique_ptr<BlockReader<int64_t>>> readers;
+            for (const auto& file : files) {
+                readers.push_back(std::make_unique<BlockReader<int64_t>>(file, io, 64));
+            }
+            std::vector<std::vector<int64_t>> result(files.size());
+            std::vector<int64_t> block;
+            for (bool more = true; more;) {
+                more = false;
+                for (size_t i = 0; i < readers.size(); ++i) {
+                    bool read = co_await readers[i]->readAsync(block, executor);
+                    if (read) {
+                        result[i].insert(result[i].end(), block.begin(), block.end());
+                        more = true;
+                    }
+                }
+            }
+            co_return result;
+        };
+        EXPECT_EQ(contents, spawn(compute_pool, readFiles(files, io_pool, compute_pool)).get());
+    }
+
+    {
+        // 200个压缩run由协程写出，再由一个计算线程归并
+        const size_t RUN_COUNT = 200;
+        std::mt19937_64 gen(43);
+        std::vector<std::vector<int64_t>> runs(RUN_COUNT);
+        std::vector<std::string> files;
+        std::vector<int64_t> all;
+        for (size_t i = 0; i < RUN_COUNT; ++i) {
+            runs[i].resize(500 + gen() % 500);
+            for (auto& value : runs[i]) {
+                value = static_cast<int64_t>(gen() % 1000000);
+            }
+            std::sort(runs[i].begin(), runs[i].end());
+            all.insert(all.end(), runs[i].begin(), runs[i].end());
+            files.push_back(test_dir + "/run_" + std::to_string(i));
+        }
+        std::sort(all.begin(), all.end());
+
+        auto writeRun = [](std::string path, std::vector<int64_t> records, ThreadPool& io,
+                           ThreadPool& executor) -> Task<void> {
+            RunWriter<int64_t> writer(path, io, RunFormat::Compressed);
+            co_await writer.writeAsync(records, executor);
+            co_await writer.closeAsync(executor);
+        };
+        for (size_t i = 0; i < RUN_COUNT; ++i) {
+            spawn(compute_pool, writeRun(files[i], runs[i], io_pool, compute_pool)).get();
+        }
+
+        auto mergeRuns = [](std::vector<std::string> files, ThreadPool& io,
+                            ThreadPool& executor) -> Task<std::vector<int64_t>> {
+            MergeCursor<int64_t, std::less<int64_t>> cursor(files, io, 64);
+            std::vector<int64_t> merged, block;
+            while (co_await cursor.nextAsync(block, executor)) {
+                merged.insert(merged.end(), block.begin(), block.end());
+            }
+            co_return merged;
+        };
+        EXPECT_EQ(all, spawn(compute_pool, mergeRuns(files, io_pool, compute_pool)).get());
+        for (const auto& file : files) {
+            EXPECT_FALSE(fs::exists(file));
+        }
+    }
+}
+
+// 测试其他整数类型：uint32 ID
+TEST_F(ExternalMergeSortTest, Uint32Records) {
+    const size_t FILE_COUNT = 4;
+    const size_t ELEMENTS_PER_FILE = 30000;
+
+    std::cout << "\n=== 测试uint32记录 ===" << std::endl;
+
+    std::mt19937 gen(42);
+    std::vector<uint32_t> all;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::vector<uint32_t> records(ELEMENTS_PER_FILE);
+        for (auto& value : records) {
+            value = gen();
+        }
+        write_records(test_dir + "/ids_" + std::to_string(i) + ".dat", records);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+
+    ExternalMergeSorter<uint32_t> sorter(test_dir, output_file, 64 * 1024, 2);
+    sorter.sort();
+
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(all, read_records<uint32_t>(output_file));
+}
+
+// 测试16字节键值记录，按键排序
+TEST_F(ExternalMergeSortTest, KeyValueRecords) {
+    struct KeyValue {
+        uint64_t key;
+        uint64_t value;
+    };
+    const size_t FILE_COUNT = 3;
+    const size_t ELEMENTS_PER_FILE = 20000;
+
+    std::cout << "\n=== 测试键值记录 ===" << std::endl;
+
+    std::mt19937_64 gen(7);
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::vector<KeyValue> records(ELEMENTS_PER_FILE);
+        for (auto& record : records) {
+            record.key = gen() % 1000;
+            record.value = record.key * 3 + 1;   // 值由键决定，便于校验记录未被拆散
+        }
+        write_records(test_dir + "/kv_" + std::to_string(i) + ".dat", records);
+    }
+
+    ExternalMergeSorter<KeyValue, KeyCompare<MemberKey<&KeyValue::key>>> sorter(test_dir, output_file, 64 * 1024, 2);
+    sorter.sort();
+
+    auto records = read_records<KeyValue>(output_file);
+    ASSERT_EQ(FILE_COUNT * ELEMENTS_PER_FILE, records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        EXPECT_EQ(records[i].key * 3 + 1, records[i].value);
+        if (i > 0) {
+            ASSERT_LE(records[i - 1].key, records[i].key);
+        }
+    }
+}
+
+// 128字节宽记录：按16字节名称排序，比较器提供规范化前缀（名称前8字节），触发前缀排序
+struct WideRecord {
+    char name[16];
+    uint64_t id;
+    char payload[104];
+};
+
+struct WideRecordCompare {
+    bool operator()(const WideRecord& a, const WideRecord& b) const {
+        return std::memcmp(a.name, b.name, sizeof(a.name)) < 0;
+    }
+
+    uint64_t prefix(const WideRecord& record) const {
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            prefix = (prefix << 8) | static_cast<unsigned char>(record.name[i]);
+        }
+        return prefix;
+    }
+};
+
+TEST_F(ExternalMergeSortTest, WideRecordsPrefixSort) {
+    using Sorter = ExternalMergeSorter<WideRecord, WideRecordCompare>;
+    static_assert(Sorter::kUsePrefixSort, "宽记录应使用前缀排序");
+
+    const size_t FILE_COUNT = 3;
+    const size_t ELEMENTS_PER_FILE = 5000;
+
+    std::cout << "\n=== 测试宽记录前缀排序 ===" << std::endl;
+
+    std::mt19937_64 gen(3);
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::vector<WideRecord> records(ELEMENTS_PER_FILE);
+        for (size_t j = 0; j < records.size(); ++j) {
+            auto& record = records[j];
+            // 前8字节只有少数几种取值，大量比较需要回退到完整名称
+            std::snprintf(record.name, sizeof(record.name), "user%04u%07u",
+                          static_cast<unsigned>(gen() % 4), static_cast<unsigned>(gen() % 10000000));
+            record.id = i * ELEMENTS_PER_FILE + j;
+            std::memset(record.payload, static_cast<int>(record.id % 251), sizeof(record.payload));
+        }
+        write_records(test_dir + "/wide_" + std::to_string(i) + ".dat", records);
+    }
+
+    Sorter sorter(test_dir, output_file, 256 * 1024, 2);
+    sorter.sort();
+
+    auto records = read_records<WideRecord>(output_file);
+    ASSERT_EQ(FILE_COUNT * ELEMENTS_PER_FILE, records.size());
+    std::vector<bool> seen(records.size(), false);
+    for (size_t i = 0; i < records.size(); ++i) {
+        ASSERT_LT(records[i].id, records.size());
+        EXPECT_FALSE(seen[records[i].id]);
+        seen[records[i].id] = true;
+        EXPECT_EQ(static_cast<char>(records[i].id % 251), records[i].payload[sizeof(records[i].payload) - 1]);
+        if (i > 0) {
+            ASSERT_LE(std::memcmp(records[i - 1].name, records[i].name, sizeof(records[i].name)), 0);
+        }
+    }
+}
+
+// 测试变长记录：字节串键（大量共享前缀，长度不一）与负载
+TEST_F(ExternalMergeSortTest, VariableLengthRecords) {
+    const size_t FILE_COUNT = 4;
+    const size_t RECORDS_PER_FILE = 5000;
+
+    std::cout << "\n=== 测试变长记录 ===" << std::endl;
+
+    std::mt19937_64 gen(11);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::string data;
+        for (size_t j = 0; j < RECORDS_PER_FILE; ++j) {
+            std::string key = (gen() % 2 ? "https://example.com/" : "user:") + std::to_string(gen() % 100000);
+            key.resize(key.size() + gen() % 3, '\0');   // 含结尾0字节的键检验前缀补0后的比较
+            VarLenFormat::append(data, key, std::string(key.rbegin(), key.rend()));
+            keys.push_back(key);
+        }
+        std::ofstream(test_dir + "/var_" + std::to_string(i) + ".dat", std::ios::binary) << data;
+    }
+
+    VarLenExternalMergeSorter sorter(test_dir, output_file, 64 * 1024, 2);
+    sorter.sort();
+
+    ThreadPool io_pool(1);
+    VarLenRunReader reader(output_file, io_pool, 4096);
+    std::vector<std::string> output_keys;
+    VarLenRecord record;
+    while (reader.next(record)) {
+        EXPECT_EQ(std::string(record.key.rbegin(), record.key.rend()), record.value);
+        output_keys.emplace_back(record.key);
+    }
+
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(keys, output_keys);
+}
+
+// 测试推送式输入：数据在内存预算内时不产生临时文件，超出时后台溢写后归并
+TEST_F(ExternalMergeSortTest, StreamingIngest) {
+    std::cout << "\n=== 测试推送式输入 ===" << std::endl;
+
+    std::mt19937_64 gen(7);
+    auto random_records = [&gen](size_t count) {
+        std::vector<int64_t> records(count);
+        for (auto& value : records) {
+            value = static_cast<int64_t>(gen());
+        }
+        return records;
+    };
+
+    // 内存充足：一次排序直接写出
+    {
+        std::vector<int64_t> records = random_records(10000);
+        ExternalMergeSorter<int64_t> sorter("", output_file, 4 * 1024 * 1024, 2);
+        sorter.add(records);
+        sorter.finish();
+
+        std::sort(records.begin(), records.end());
+        EXPECT_EQ(records, read_records<int64_t>(output_file));
+        EXPECT_FALSE(fs::exists(output_file + ".spill0"));
+    }
+
+    // 内存不足：分批推送，多次溢写后归并
+    {
+        std::vector<int64_t> all;
+        ExternalMergeSorter<int64_t> sorter("", output_file, 64 * 1024, 2);
+        for (size_t batch = 0; batch < 50; ++batch) {
+            std::vector<int64_t> records = random_records(1000 + batch);
+            sorter.add(records);
+            all.insert(all.end(), records.begin(), records.end());
+        }
+        sorter.finish();
+        EXPECT_THROW(sorter.add(std::span<const int64_t>(all.data(), 1)), std::runtime_error);
+
+        std::sort(all.begin(), all.end());
+        EXPECT_EQ(all, read_records<int64_t>(output_file));
+        for (size_t i = 0; i < 30; ++i) {
+            EXPECT_FALSE(fs::exists(output_file + ".spill" + std::to_string(i)));
+        }
+    }
+
+    // 放弃推送（未调用finish）：析构时删除已溢写的run
+    {
+        {
+            ExternalMergeSorter<int64_t> sorter("", output_file, 64 * 1024, 2);
+            for (size_t batch = 0; batch < 10; ++batch) {
+                sorter.add(random_records(1000));
+            }
+            EXPECT_TRUE(fs::exists(output_file + ".spill0"));
+        }
+        for (size_t i = 0; i < 30; ++i) {
+            EXPECT_FALSE(fs::exists(output_file + ".spill" + std::to_string(i)));
+        }
+    }
+}
+
+// 测试拉取式输出：按块拉取最后一轮归并的结果，提前结束时删除剩余的run
+TEST_F(ExternalMergeSortTest, PullSortedOutput) {
+    const size_t FILE_COUNT = 6;
+    const size_t ELEMENTS_PER_FILE = 20000;
+
+    std::cout << "\n=== 测试拉取式输出 ===" << std::endl;
+
+    generate_multiple_test_files(FILE_COUNT, ELEMENTS_PER_FILE);
+    auto expected = read_records<int64_t>(test_dir + "/data_0.dat");
+    for (size_t i = 1; i < FILE_COUNT; ++i) {
+        auto records = read_records<int64_t>(test_dir + "/data_" + std::to_string(i) + ".dat");
+        expected.insert(expected.end(), records.begin(), records.end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    auto countRuns = [this]() {
+        size_t runs = 0;
+        for (const auto& entry : fs::recursive_directory_iterator(test_dir)) {
+            if (entry.path().string().find(".sorted") != std::string::npos) {
+                ++runs;
+            }
+        }
+        return runs;
+    };
+
+    {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 256 * 1024, 2);
+        auto cursor = sorter.sortedCursor();
+        std::vector<int64_t> all, block;
+        while (cursor.next(block)) {
+            all.insert(all.end(), block.begin(), block.end());
+        }
+        EXPECT_EQ(expected, all);
+        EXPECT_FALSE(fs::exists(output_file));
+        EXPECT_EQ(0u, countRuns());
+    }
+
+    {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 256 * 1024, 2);
+        std::vector<int64_t> head;
+        sorter.sortTo([&head](const int64_t* records, size_t count) {
+            head.insert(head.end(), records, records + count);
+            return head.size() < 1000;
+        });
+        ASSERT_GE(head.size(), 1000u);
+        EXPECT_TRUE(std::equal(head.begin(), head.end(), expected.begin()));
+        EXPECT_EQ(0u, countRuns());
+    }
+}
+
+// 测试Top-K：K较小时单遍筛选，K较大时截断run后归并
+TEST_F(ExternalMergeSortTest, TopK) {
+    const size_t FILE_COUNT = 5;
+    const size_t ELEMENTS_PER_FILE = 20000;
+
+    std::cout << "\n=== 测试Top-K ===" << std::endl;
+
+    generate_multiple_test_files(FILE_COUNT, ELEMENTS_PER_FILE);
+    std::vector<int64_t> expected;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        auto records = read_records<int64_t>(test_dir + "/data_" + std::to_string(i) + ".dat");
+        expected.insert(expected.end(), records.begin(), records.end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    for (size_t k : {size_t(0), size_t(1), size_t(100), size_t(30000), FILE_COUNT * ELEMENTS_PER_FILE + 10}) {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 128 * 1024, 2);
+        sorter.topK(k);
+
+        std::vector<int64_t> head(expected.begin(), expected.begin() + std::min(k, expected.size()));
+        EXPECT_EQ(head, read_records<int64_t>(output_file)) << "K=" << k;
+        for (const auto& entry : fs::directory_iterator(test_dir)) {
+            EXPECT_EQ(std::string::npos, entry.path().string().find(".sorted")) << "K=" << k;
+        }
+    }
+}
+
+// 测试外部选择：分位数与排序后的结果一致，且不产生输出文件
+TEST_F(ExternalMergeSortTest, ExternalSelection) {
+    const size_t FILE_COUNT = 4;
+    const size_t ELEMENTS_PER_FILE = 50000;
+
+    std::cout << "\n=== 测试外部选择 ===" << std::endl;
+
+    generate_multiple_test_files(FILE_COUNT, ELEMENTS_PER_FILE);
+    // 加入大量重复值，检验区间边界上的相等记录
+    std::vector<int64_t> repeated(30000, 12345);
+    write_records(test_dir + "/repeated.dat", repeated);
+
+    std::vector<int64_t> expected = repeated;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        auto records = read_records<int64_t>(test_dir + "/data_" + std::to_string(i) + ".dat");
+        expected.insert(expected.end(), records.begin(), records.end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    // 内存限制很小，需要采样并多遍缩小区间
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 2);
+    std::vector<uint64_t> ranks = {0, 1, expected.size() / 2, expected.size() * 99 / 100, expected.size() - 1};
+    auto answers = sorter.select(ranks);
+    ASSERT_EQ(ranks.size(), answers.size());
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        EXPECT_EQ(expected[ranks[i]], answers[i]) << "rank=" << ranks[i];
+    }
+
+    auto median = sorter.quantiles({0.5, 0.999});
+    EXPECT_EQ(expected[(expected.size() - 1) / 2], median[0]);
+    EXPECT_EQ(expected[static_cast<size_t>(0.999 * (expected.size() - 1))], median[1]);
+    EXPECT_FALSE(fs::exists(output_file));
+    EXPECT_THROW(sorter.select({expected.size()}), std::runtime_error);
+}
+
+// 测试去重模式：run生成和每次归并都去掉等价记录
+TEST_F(ExternalMergeSortTest, DistinctMode) {
+    const size_t FILE_COUNT = 8;
+    const size_t ELEMENTS_PER_FILE = 20000;
+
+    std::cout << "\n=== 测试去重模式 ===" << std::endl;
+
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<int64_t> dist(-500, 500);
+    std::vector<int64_t> all;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::vector<int64_t> records(ELEMENTS_PER_FILE);
+        for (auto& value : records) {
+            value = dist(gen);
+        }
+        write_records(test_dir + "/dup_" + std::to_string(i) + ".dat", records);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 2);
+    sorter.setDistinct(true);
+    sorter.sort();
+
+    std::sort(all.begin(), all.end());
+    all.erase(std::unique(all.begin(), all.end()), all.end());
+    EXPECT_EQ(all, read_records<int64_t>(output_file));
+
+    // Top-K同样去重：单遍筛选（k较小）和截断run后归并（k超出候选缓冲区）都输出前k个不同的键
+    sorter.topK(100);
+    EXPECT_EQ(std::vector<int64_t>(all.begin(), all.begin() + 100), read_records<int64_t>(output_file));
+
+    ExternalMergeSorter<int64_t> external(test_dir, output_file, 16 * 1024, 2);
+    external.setDistinct(true);
+    external.topK(300);
+    EXPECT_EQ(std::vector<int64_t>(all.begin(), all.begin() + 300), read_records<int64_t>(output_file));
+}
+
+// 测试聚合排序：等价的键在run生成和每次归并时合并，输出(键, 计数)和(键, 值之和)
+TEST_F(ExternalMergeSortTest, AggregatingSort) {
+    struct KeyCount {
+        int64_t key;
+        uint64_t count;
+    };
+    const size_t FILE_COUNT = 6;
+    const size_t ELEMENTS_PER_FILE = 20000;
+
+    std::cout << "\n=== 测试聚合排序 ===" << std::endl;
+
+    std::mt19937_64 gen(5);
+    std::map<int64_t, uint64_t> counts;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::vector<KeyCount> records(ELEMENTS_PER_FILE);
+        for (auto& record : records) {
+            record = {static_cast<int64_t>(gen() % 300) - 150, 1};
+            counts[record.key]++;
+        }
+        write_records(test_dir + "/events_" + std::to_string(i) + ".dat", records);
+    }
+
+    {
+        ExternalMergeSorter<KeyCount, KeyCompare<MemberKey<&KeyCount::key>>, SumMember<&KeyCount::count>> sorter(
+            test_dir, output_file, 64 * 1024, 2);
+        sorter.sort();
+
+        auto records = read_records<KeyCount>(output_file);
+        ASSERT_EQ(counts.size(), records.size());
+        auto it = counts.begin();
+        for (const auto& record : records) {
+            EXPECT_EQ(it->first, record.key);
+            EXPECT_EQ(it->second, record.count);
+            ++it;
+        }
+    }
+
+    // Top-K输出前k个键的聚合结果：单遍筛选（k较小）和截断run后归并（k超出候选缓冲区）
+    for (auto [memory, k] : {std::pair<size_t, size_t>{64 * 1024, 50}, {16 * 1024, 200}}) {
+        ExternalMergeSorter<KeyCount, KeyCompare<MemberKey<&KeyCount::key>>, SumMember<&KeyCount::count>> sorter(
+            test_dir, output_file, memory, 2);
+        sorter.topK(k);
+
+        auto records = read_records<KeyCount>(output_file);
+        ASSERT_EQ(k, records.size());
+        auto it = counts.begin();
+        for (const auto& record : records) {
+            EXPECT_EQ(it->first, record.key);
+            EXPECT_EQ(it->second, record.count);
+            ++it;
+        }
+    }
+
+    // 宽记录走前缀排序路径，按名称对id求和
+    fs::remove_all(test_dir);
+    fs::create_directories(test_dir);
+    std::map<std::string, uint64_t> sums;
+    for (size_t i = 0; i < 3; ++i) {
+        std::vector<WideRecord> records(4000);
+        for (auto& record : records) {
+            std::memset(&record, 0, sizeof(record));
+            std::snprintf(record.name, sizeof(record.name), "user%04u", static_cast<unsigned>(gen() % 50));
+            record.id = gen() % 1000;
+            sums[record.name] += record.id;
+        }
+        write_records(test_dir + "/wide_" + std::to_string(i) + ".dat", records);
+    }
+
+    {
+        ExternalMergeSorter<WideRecord, WideRecordCompare, SumMember<&WideRecord::id>> sorter(
+            test_dir, output_file, 256 * 1024, 2);
+        sorter.sort();
+
+        auto records = read_records<WideRecord>(output_file);
+        ASSERT_EQ(sums.size(), records.size());
+        auto it = sums.begin();
+        for (const auto& record : records) {
+            EXPECT_EQ(it->first, std::string(record.name));
+            EXPECT_EQ(it->second, record.id);
+            ++it;
+        }
+    }
+}
+
+// 测试范围分区输出：各分区内部有序、互不重叠，拼接后即为完整的排序结果，大小大致均衡
+TEST_F(ExternalMergeSortTest, RangePartitionedOutput) {
+    const size_t FILE_COUNT = 6;
+    const size_t ELEMENTS_PER_FILE = 20000;
+    const size_t PARTITIONS = 4;
+
+    std::cout << "\n=== 测试范围分区输出 ===" << std::endl;
+
+    generate_multiple_test_files(FILE_COUNT, ELEMENTS_PER_FILE);
+    std::vector<int64_t> expected;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        auto records = read_records<int64_t>(test_dir + "/data_" + std::to_string(i) + ".dat");
+        expected.insert(expected.end(), records.begin(), records.end());
+    }
+    std::sort(expected.begin(), expected.end());
+
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 128 * 1024, 2);
+    auto parts = sorter.sortPartitioned(PARTITIONS);
+    ASSERT_EQ(PARTITIONS, parts.size());
+
+    std::vector<int64_t> concatenated;
+    for (const auto& part : parts) {
+        auto records = read_records<int64_t>(part);
+        EXPECT_TRUE(std::is_sorted(records.begin(), records.end()));
+        EXPECT_GT(records.size(), expected.size() / PARTITIONS / 2);
+        EXPECT_LT(records.size(), expected.size() / PARTITIONS * 2);
+        concatenated.insert(concatenated.end(), records.begin(), records.end());
+        fs::remove(part);
+    }
+    EXPECT_EQ(expected, concatenated);
+    for (const auto& entry : fs::directory_iterator(test_dir)) {
+        EXPECT_EQ(std::string::npos, entry.path().string().find(".sorted"));
+    }
+}
+
+// 测试降序与自定义比较器：比较器为模板参数，预排序、宽记录前缀排序和归并都按其顺序
+TEST_F(ExternalMergeSortTest, DescendingAndCustomOrder) {
+    std::cout << "\n=== 测试降序与自定义比较器 ===" << std::endl;
+
+    generate_multiple_test_files(4, 20000);
+    std::vector<int64_t> values;
+    for (size_t i = 0; i < 4; ++i) {
+        auto records = read_records<int64_t>(test_dir + "/data_" + std::to_string(i) + ".dat");
+        values.insert(values.end(), records.begin(), records.end());
+    }
+
+    {
+        ExternalMergeSorter<int64_t, std::greater<int64_t>> sorter(test_dir, output_file, 64 * 1024, 2);
+        sorter.sort();
+        auto expected = values;
+        std::sort(expected.begin(), expected.end(), std::greater<int64_t>());
+        EXPECT_EQ(expected, read_records<int64_t>(output_file));
+    }
+
+    {
+        // 自定义顺序：按绝对值升序，绝对值相同时负数在前
+        struct AbsLess {
+            bool operator()(int64_t a, int64_t b) const {
+                uint64_t ua = a < 0 ? 0 - static_cast<uint64_t>(a) : a;
+                uint64_t ub = b < 0 ? 0 - static_cast<uint64_t>(b) : b;
+                return ua != ub ? ua < ub : a < b;
+            }
+        };
+        ExternalMergeSorter<int64_t, AbsLess> sorter(test_dir, output_file, 64 * 1024, 2);
+        sorter.sort();
+        auto expected = values;
+        std::sort(expected.begin(), expected.end(), AbsLess());
+        EXPECT_EQ(expected, read_records<int64_t>(output_file));
+    }
+
+    // 宽记录按数值键降序，走前缀排序路径（前缀取反）
+    struct WideByScore {
+        double score;
+        uint64_t id;
+        char payload[112];
+    };
+    using Sorter = ExternalMergeSorter<WideByScore, KeyCompare<MemberKey<&WideByScore::score>, std::greater<>>>;
+    static_assert(Sorter::kUsePrefixSort, "降序的算术键应提供前缀");
+
+    fs::remove_all(test_dir);
+    fs::create_directories(test_dir);
+    std::mt19937_64 gen(9);
+    std::vector<WideByScore> wide(6000);
+    for (size_t i = 0; i < wide.size(); ++i) {
+        std::memset(&wide[i], 0, sizeof(wide[i]));
+        wide[i].score = static_cast<double>(gen() % 2000) - 1000.5;
+        wide[i].id = i;
+    }
+    write_records(test_dir + "/wide.dat", wide);
+
+    Sorter sorter(test_dir, output_file, 128 * 1024, 2);
+    sorter.sort();
+    auto records = read_records<WideByScore>(output_file);
+    ASSERT_EQ(wide.size(), records.size());
+    for (size_t i = 1; i < records.size(); ++i) {
+        ASSERT_GE(records[i - 1].score, records[i].score);
+    }
+}
+
+// 测试压缩run：临时run明显变小，经过多轮归并后最终输出仍为原始格式且结果正确
+TEST_F(ExternalMergeSortTest, CompressedRuns) {
+    const size_t FILE_COUNT = 200;
+    const size_t ELEMENTS_PER_FILE = 2000;
+
+    std::cout << "\n=== 测试压缩run ===" << std::endl;
+
+    std::mt19937_64 gen(13);
+    std::vector<int64_t> all;
+    uintmax_t raw_bytes = 0;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::vector<int64_t> records(ELEMENTS_PER_FILE);
+        for (auto& value : records) {
+            value = static_cast<int64_t>(gen() % 10000000) - 5000000;
+        }
+        // 一个文件包含极端值，检验差值溢出时的往返
+        if (i == 0) {
+            records[0] = INT64_MIN;
+            records[1] = INT64_MAX;
+        }
+        write_records(test_dir + "/data_" + std::to_string(i) + ".dat", records);
+        all.insert(all.end(), records.begin(), records.end());
+        raw_bytes += records.size() * sizeof(int64_t);
+    }
+    std::sort(all.begin(), all.end());
+
+    {
+        // 预排序和中间归并后检查run的总大小
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 2);
+        sorter.setCompressRuns(true);
+        auto cursor = sorter.sortedCursor();
+        uintmax_t run_bytes = 0;
+        for (const auto& entry : fs::directory_iterator(test_dir)) {
+            if (entry.path().string().find(".sorted") != std::string::npos) {
+                run_bytes += entry.file_size();
+            }
+        }
+        EXPECT_LT(run_bytes * 3, raw_bytes);
+
+        std::vector<int64_t> merged, block;
+        while (cursor.next(block)) {
+            merged.insert(merged.end(), block.begin(), block.end());
+        }
+        EXPECT_EQ(all, merged);
+    }
+
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 2);
+    sorter.setCompressRuns(true);
+    sorter.sort();
+    EXPECT_EQ(all, read_records<int64_t>(output_file));
+
+    struct Pair {
+        int64_t a, b;
+    };
+    ExternalMergeSorter<Pair, KeyCompare<MemberKey<&Pair::a>>> pair_sorter(test_dir, output_file);
+    EXPECT_THROW(pair_sorter.setCompressRuns(true), std::runtime_error);
+
+    // 读取器每次最多取出block_elements个记录，比一帧小时一帧分多次解码
+    ThreadPool io_pool(1);
+    const std::string run = test_dir + "/frames.run";
+    std::vector<int64_t> expected(all.begin(), all.begin() + 3 * DeltaVarintCodec<int64_t>::kFrameRecords + 17);
+    std::vector<int64_t> block = expected;
+    RunWriter<int64_t> writer(run, io_pool, RunFormat::Compressed);
+    writer.write(block);
+    writer.close();
+
+    RunReader<int64_t> reader(run, io_pool, 100);
+    std::vector<int64_t> decoded;
+    while (reader.read(block)) {
+        EXPECT_LE(block.size(), 100u);
+        decoded.insert(decoded.end(), block.begin(), block.end());
+    }
+    reader.close();
+    EXPECT_EQ(expected, decoded);
+}
+
+// 测试run索引：记录数、键范围和fence写在run末尾，读取器只返回数据部分，按fence定位和截断结果正确
+TEST_F(ExternalMergeSortTest, RunIndex) {
+    std::cout << "\n=== 测试run索引 ===" << std::endl;
+
+    ThreadPool io_pool(2);
+    const size_t COUNT = 3 * RunIndex<int64_t>::kFenceRecords + 100;
+    std::vector<int64_t> records(COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+        records[i] = static_cast<int64_t>(i / 3) * 2;   // 有重复键，只有偶数
+    }
+
+    for (RunFormat format : {RunFormat::Raw, RunFormat::Compressed}) {
+        const std::string path = test_dir + "/indexed.run";
+        {
+            // 分两块写出，第二块从块中间开始，fence仍按记录下标对齐
+            RunWriter<int64_t> writer(path, io_pool, format);
+            std::vector<int64_t> first(records.begin(), records.begin() + 1000);
+            std::vector<int64_t> second(records.begin() + 1000, records.end());
+            writer.write(first);
+            writer.write(second);
+            writer.close();
+        }
+
+        RunIndex<int64_t> index = RunIndex<int64_t>::load(path);
+        EXPECT_EQ(COUNT, index.count);
+        EXPECT_EQ(records.front(), index.min);
+        EXPECT_EQ(records.back(), index.max);
+        EXPECT_EQ(format == RunFormat::Compressed, index.compressed);
+        ASSERT_FALSE(index.fence_keys.empty());
+        for (size_t j = 0; j < index.fence_keys.size(); ++j) {
+            EXPECT_EQ(records[index.fence_records[j]], index.fence_keys[j]);
+        }
+
+        // 按fence定位的区间必须包含真正的lower_bound / upper_bound
+        for (int64_t key : {int64_t(-1), int64_t(0), int64_t(1), int64_t(2731), int64_t(2732), records.back(),
+                            records.back() + 1}) {
+            uint64_t lower = std::lower_bound(records.begin(), records.end(), key) - records.begin();
+            uint64_t upper = std::upper_bound(records.begin(), records.end(), key) - records.begin();
+            auto [lo_first, lo_last] = index.locate(key, std::less<int64_t>(), false);
+            auto [up_first, up_last] = index.locate(key, std::less<int64_t>(), true);
+            EXPECT_LE(lo_first, lower);
+            EXPECT_GE(lo_last, lower);
+            EXPECT_LE(lo_last - lo_first, RunIndex<int64_t>::kFenceRecords);
+            EXPECT_LE(up_first, upper);
+            EXPECT_GE(up_last, upper);
+        }
+
+        std::vector<int64_t> read, block;
+        RunReader<int64_t> reader(path, io_pool, 500);
+        while (reader.read(block)) {
+            read.insert(read.end(), block.begin(), block.end());
+        }
+        reader.close();
+        EXPECT_EQ(records, read);
+
+        if (format == RunFormat::Raw) {
+            // 截断后索引随之更新，片段读取不越过数据部分
+            const uint64_t kept = RunIndex<int64_t>::kFenceRecords + 7;
+            truncateRun<int64_t>(path, kept);
+            index = RunIndex<int64_t>::load(path);
+            EXPECT_EQ(kept, index.count);
+            EXPECT_EQ(records[kept - 1], index.max);
+            EXPECT_EQ(2u, index.fence_keys.size());
+
+            RunReader<int64_t> slice(path, io_pool, 500, kept - 3);
+            std::vector<int64_t> tail;
+            while (slice.read(block)) {
+                tail.insert(tail.end(), block.begin(), block.end());
+            }
+            slice.close();
+            EXPECT_EQ(std::vector<int64_t>(records.begin() + (kept - 3), records.begin() + kept), tail);
+        }
+        fs::remove(path);
+    }
+
+    // 最终输出只有原始记录，不带索引
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 2);
+    write_records(test_dir + "/data.dat", records);
+    sorter.sort();
+    EXPECT_EQ(records, read_records<int64_t>(output_file));
+    EXPECT_THROW(RunIndex<int64_t>::load(output_file), std::runtime_error);
+}
+
+// 测试不重叠run的拼接：按时间分区的输入键范围互不重叠，超过一轮归并的扇入时也不需要中间归并，
+// 少量重叠的run仍然正确归并；去重模式下端点等价的run必须一起归并
+TEST_F(ExternalMergeSortTest, DisjointRunsConcatenated) {
+    const size_t FILE_COUNT = 300;   // 超过kMergeFactor
+    const size_t ELEMENTS_PER_FILE = 500;
+
+    std::cout << "\n=== 测试不重叠run的拼接 ===" << std::endl;
+
+    std::mt19937_64 gen(17);
+    std::vector<int64_t> all;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        // 每个文件是一天的日志：键在[i * 1000, i * 1000 + 999]内，文件内乱序；相邻两天共享端点键
+        std::vector<int64_t> records(ELEMENTS_PER_FILE);
+        for (auto& value : records) {
+            value = static_cast<int64_t>(i * 1000 + gen() % 1000);
+        }
+        records[0] = static_cast<int64_t>(i * 1000);
+        records[1] = static_cast<int64_t>(i * 1000 + 1000);
+        write_records(test_dir + "/day_" + std::to_string(i) + ".dat", records);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+    // 追加少量迟到的数据，只与其中几天的键范围重叠
+    std::vector<int64_t> late;
+    for (size_t i = 0; i < 200; ++i) {
+        late.push_back(static_cast<int64_t>(50000 + gen() % 3000));
+    }
+    write_records(test_dir + "/late.dat", late);
+    all.insert(all.end(), late.begin(), late.end());
+    std::sort(all.begin(), all.end());
+
+    auto no_temp_files = [this]() {
+        for (const auto& entry : fs::directory_iterator(test_dir)) {
+            const std::string path = entry.path().string();
+            if (path.find(".sorted") != std::string::npos || path.find(".intermediate") != std::string::npos) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (bool compress : {false, true}) {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 4);
+        sorter.setCompressRuns(compress);
+        sorter.sort();
+        EXPECT_EQ(all, read_records<int64_t>(output_file)) << "compress=" << compress;
+        EXPECT_TRUE(no_temp_files());
+        // 只有与迟到数据重叠的几天需要归并，其余run都直接复制
+        EXPECT_GE(sorter.copiedRuns(), FILE_COUNT - 5) << "compress=" << compress;
+    }
+
+    {
+        // 拉取式输出按run数做中间归并，不重叠的组在中间轮次中同样直接复制
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 64 * 1024, 4);
+        auto cursor = sorter.sortedCursor();
+        std::vector<int64_t> merged, block;
+        while (cursor.next(block)) {
+            merged.insert(merged.end(), block.begin(), block.end());
+        }
+        EXPECT_EQ(all, merged);
+        EXPECT_GE(sorter.copiedRuns(), FILE_COUNT - 5);
+    }
+
+    ExternalMergeSorter<int64_t> distinct_sorter(test_dir, output_file, 64 * 1024, 4);
+    distinct_sorter.setDistinct(true);
+    distinct_sorter.sort();
+    std::vector<int64_t> unique_all = all;
+    unique_all.erase(std::unique(unique_all.begin(), unique_all.end()), unique_all.end());
+    EXPECT_EQ(unique_all, read_records<int64_t>(output_file));
+    EXPECT_TRUE(no_temp_files());
+}
+
+// 测试输出索引：排序时顺带生成旁路索引，按键查询的结果与在内存中二分一致
+TEST_F(ExternalMergeSortTest, OutputIndexLookups) {
+    std::cout << "\n=== 测试输出索引 ===" << std::endl;
+
+    std::mt19937_64 gen(23);
+    std::vector<int64_t> all;
+    for (size_t i = 0; i < 20; ++i) {
+        std::vector<int64_t> records(10000);
+        for (auto& value : records) {
+            value = static_cast<int64_t>(gen() % 50000);   // 大量重复键
+        }
+        write_records(test_dir + "/data_" + std::to_string(i) + ".dat", records);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+
+    auto check = [&](const std::vector<int64_t>& expected) {
+        SortedFileReader<int64_t> reader(output_file);
+        ASSERT_EQ(expected.size(), reader.size());
+        for (int64_t key : {int64_t(-1), int64_t(0), int64_t(1), int64_t(25000), int64_t(49999), int64_t(50000)}) {
+            EXPECT_EQ(uint64_t(std::lower_bound(expected.begin(), expected.end(), key) - expected.begin()),
+                      reader.lower_bound(key)) << key;
+            EXPECT_EQ(uint64_t(std::upper_bound(expected.begin(), expected.end(), key) - expected.begin()),
+                      reader.upper_bound(key)) << key;
+        }
+        for (int i = 0; i < 200; ++i) {
+            int64_t lo = static_cast<int64_t>(gen() % 50000);
+            int64_t hi = lo + static_cast<int64_t>(gen() % 100);
+            auto first = std::lower_bound(expected.begin(), expected.end(), lo);
+            auto last = std::lower_bound(expected.begin(), expected.end(), hi);
+            ASSERT_EQ(std::vector<int64_t>(first, last), reader.range(lo, hi)) << lo << " " << hi;
+        }
+        if (!expected.empty()) {
+            EXPECT_EQ(expected.back(), reader.at(expected.size() - 1));
+        }
+    };
+
+    std::sort(all.begin(), all.end());
+    {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 256 * 1024, 4);
+        sorter.setOutputIndex(true);
+        sorter.sort();
+        check(all);
+    }
+
+    {
+        // 推送式输入：未溢写、单个run重命名和多个run归并三种输出路径
+        for (size_t memory : {size_t(8) * 1024 * 1024, all.size() * sizeof(int64_t) * 3, size_t(64) * 1024}) {
+            ExternalMergeSorter<int64_t> sorter("", output_file, memory, 2);
+            sorter.setOutputIndex(true);
+            sorter.add(all);
+            sorter.finish();
+            check(all);
+        }
+    }
+
+    // 降序输出配合降序比较器查询
+    ExternalMergeSorter<int64_t, std::greater<int64_t>> descending(test_dir, output_file, 256 * 1024, 4);
+    descending.setOutputIndex(true);
+    descending.sort();
+    SortedFileReader<int64_t, std::greater<int64_t>> reader(output_file);
+    std::vector<int64_t> reversed(all.rbegin(), all.rend());
+    EXPECT_EQ(uint64_t(std::lower_bound(reversed.begin(), reversed.end(), 30000, std::greater<int64_t>()) -
+                       reversed.begin()),
+              reader.lower_bound(30000));
+    EXPECT_EQ(std::vector<int64_t>(reversed.begin(), reversed.begin() + reader.lower_bound(49990)),
+              reader.range(50000, 49990));
+}
+
+// 测试文本格式输入输出
+TEST_F(ExternalMergeSortTest, TextFormat) {
+    std::cout << "\n=== 测试文本格式 ===" << std::endl;
+
+    // 编解码往返，包括各类型的极值
+    {
+        std::vector<int64_t> values = {0, 1, -1, 9, 10, 99999999, 100000000, -123456789012345678LL, INT64_MIN,
+                                       INT64_MAX};
+        std::vector<char> text;
+        DecimalTextCodec<int64_t>::format(values.data(), values.size(), text);
+        std::vector<int64_t> parsed;
+        EXPECT_EQ(text.data() + text.size(),
+                  DecimalTextCodec<int64_t>::parse(text.data(), text.data() + text.size(), parsed, SIZE_MAX));
+        EXPECT_EQ(values, parsed);
+
+        std::vector<uint64_t> unsigned_values = {UINT64_MAX, 10000000000000000000ULL, 0};
+        std::vector<char> unsigned_text;
+        DecimalTextCodec<uint64_t>::format(unsigned_values.data(), unsigned_values.size(), unsigned_text);
+        EXPECT_EQ("18446744073709551615\n10000000000000000000\n0\n",
+                  std::string(unsigned_text.begin(), unsigned_text.end()));
+        std::vector<uint64_t> unsigned_parsed;
+        DecimalTextCodec<uint64_t>::parse(unsigned_text.data(), unsigned_text.data() + unsigned_text.size(),
+                                          unsigned_parsed, SIZE_MAX);
+        EXPECT_EQ(unsigned_values, unsigned_parsed);
+
+        for (std::string bad : {"12a\n", "-\n", "18446744073709551616\n", "9223372036854775808\n", "1 2\n"}) {
+            std::vector<int64_t> out;
+            EXPECT_THROW(DecimalTextCodec<int64_t>::parse(bad.data(), bad.data() + bad.size(), out, SIZE_MAX),
+                         std::runtime_error) << bad;
+        }
+    }
+
+    // 文本输入文件：混合"\r\n"、空行，最后一行没有换行符
+    std::mt19937_64 gen(31);
+    std::vector<int64_t> all;
+    for (size_t i = 0; i < 8; ++i) {
+        std::ofstream file(test_dir + "/data_" + std::to_string(i) + ".txt", std::ios::binary);
+        for (size_t j = 0; j < 20000; ++j) {
+            int64_t value = j % 3 == 0 ? static_cast<int64_t>(gen()) : static_cast<int64_t>(gen() % 2000000) - 1000000;
+            all.push_back(value);
+            file << value << (j % 7 == 0 ? "\r\n" : "\n");
+            if (j % 1000 == 0) {
+                file << "\n";
+            }
+        }
+        int64_t last = -static_cast<int64_t>(i);
+        all.push_back(last);
+        file << last;
+    }
+    std::sort(all.begin(), all.end());
+
+    auto read_text = [&]() {
+        std::ifstream file(output_file);
+        std::vector<int64_t> records;
+        int64_t value;
+        while (file >> value) {
+            records.push_back(value);
+        }
+        return records;
+    };
+
+    {
+        // 内存很小：输入按小块解析，行跨越预读块的边界；多个chunk和多轮归并
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 256 * 1024, 4);
+        sorter.setTextInput(true);
+        sorter.setTextOutput(true);
+        sorter.sort();
+        EXPECT_EQ(all, read_text());
+    }
+
+    {
+        // 文本输入、二进制输出
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 16 * 1024 * 1024, 2);
+        sorter.setTextInput(true);
+        sorter.sort();
+        EXPECT_EQ(all, read_records<int64_t>(output_file));
+    }
+
+    {
+        // Top-K的两种实现都写出文本
+        for (size_t memory : {size_t(64) * 1024 * 1024, size_t(128) * 1024}) {
+            ExternalMergeSorter<int64_t> sorter(test_dir, output_file, memory, 2);
+            sorter.setTextInput(true);
+            sorter.setTextOutput(true);
+            sorter.topK(5000);
+            EXPECT_EQ(std::vector<int64_t>(all.begin(), all.begin() + 5000), read_text());
+        }
+    }
+
+    {
+        // 推送式输入：未溢写和单个run两种路径的文本输出
+        for (size_t memory : {size_t(64) * 1024 * 1024, all.size() * sizeof(int64_t) * 3}) {
+            ExternalMergeSorter<int64_t> sorter("", output_file, memory, 2);
+            sorter.setTextOutput(true);
+            sorter.add(all);
+            sorter.finish();
+            EXPECT_EQ(all, read_text());
+        }
+    }
+
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 256 * 1024, 2);
+    sorter.setTextOutput(true);
+    EXPECT_THROW(sorter.setOutputIndex(true), std::runtime_error);
+    sorter.setTextInput(true);
+    EXPECT_THROW(sorter.select({0}), std::runtime_error);
+}
+
+// 测试把临时run分散到多个临时目录
+TEST_F(ExternalMergeSortTest, TempDirs) {
+    const size_t FILE_COUNT = 200;   // 超过kMergeFactor，需要中间归并
+    const size_t ELEMENTS_PER_FILE = 2000;
+
+    std::cout << "\n=== 测试多个临时目录 ===" << std::endl;
+
+    std::vector<int64_t> all;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        // 分散到两个子目录中，两个子目录中的文件同名
+        std::string file = test_dir + "/" + std::to_string(i % 2) + "/data_" + std::to_string(i / 2) + ".dat";
+        fs::create_directories(fs::path(file).parent_path());
+        generate_test_file(file, ELEMENTS_PER_FILE);
+        auto records = read_records<int64_t>(file);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    std::vector<std::string> temp_dirs;
+    for (size_t i = 0; i < 3; ++i) {
+        temp_dirs.push_back(test_dir + "_tmp" + std::to_string(i));
+    }
+    auto count_files = [](const std::string& dir) {
+        size_t files = 0;
+        for (const auto& entry : fs::recursive_directory_iterator(dir)) {
+            files += entry.is_regular_file();
+        }
+        return files;
+    };
+
+    {
+        // 预排序和中间归并之后，剩余的run都在临时目录中，且轮流放在不同的目录里
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 512 * 1024, 4);
+        sorter.setTempDirs(temp_dirs);
+        auto cursor = sorter.sortedCursor();
+        EXPECT_EQ(FILE_COUNT, count_files(test_dir));
+        size_t used_dirs = 0;
+        for (const auto& dir : temp_dirs) {
+            used_dirs += count_files(dir) > 0;
+        }
+        EXPECT_GE(used_dirs, 2u);
+
+        std::vector<int64_t> merged, block;
+        while (cursor.next(block)) {
+            merged.insert(merged.end(), block.begin(), block.end());
+        }
+        EXPECT_EQ(all, merged);
+    }
+
+    for (bool compress : {false, true}) {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 512 * 1024, 4);
+        sorter.setTempDirs(temp_dirs);
+        sorter.setCompressRuns(compress);
+        sorter.sort();
+        EXPECT_EQ(all, read_records<int64_t>(output_file)) << "compress=" << compress;
+        EXPECT_EQ(FILE_COUNT, count_files(test_dir));
+        for (const auto& dir : temp_dirs) {
+            EXPECT_EQ(0u, count_files(dir)) << dir;
+        }
+    }
+
+    // 推送式输入的溢写run同样放在临时目录中
+    for (size_t memory : {all.size() * sizeof(int64_t) * 3, size_t(256) * 1024}) {
+        ExternalMergeSorter<int64_t> sorter("", output_file, memory, 2);
+        sorter.setTempDirs(temp_dirs);
+        sorter.add(all);
+        sorter.finish();
+        EXPECT_EQ(all, read_records<int64_t>(output_file));
+        EXPECT_FALSE(fs::exists(output_file + ".spill0"));
+        for (const auto& dir : temp_dirs) {
+            EXPECT_EQ(0u, count_files(dir)) << dir;
+        }
+    }
+
+    // 目录名不规范（"./"前缀、末尾的'/'）时，run仍按所在目录交错排列
+    class TempDirSorter : public ExternalMergeSorter<int64_t> {
+    public:
+        using ExternalMergeSorter<int64_t>::ExternalMergeSorter;
+        using ExternalMergeSorterBase::tempPath;
+        using ExternalMergeSorterBase::interleaveByTempDir;
+    };
+    TempDirSorter sorter(test_dir, output_file, 512 * 1024, 2);
+    sorter.setTempDirs({"./" + temp_dirs[0] + "/", temp_dirs[1] + "//", temp_dirs[2]});
+    std::vector<std::string> runs;
+    for (size_t i = 0; i < 6; ++i) {
+        runs.push_back(sorter.tempPath(output_file + ".run"));   // 依次轮转到目录0、1、2、0、1、2
+    }
+    std::vector<std::string> by_dir = {runs[0], runs[3], runs[1], runs[4], runs[2], runs[5]};
+    sorter.interleaveByTempDir(by_dir);
+    EXPECT_EQ(runs, by_dir);
+
+    for (const auto& dir : temp_dirs) {
+        fs::remove_all(dir);
+    }
+}
+
+// 测试小run放入内存临时层
+TEST_F(ExternalMergeSortTest, MemoryTempTier) {
+    const size_t FILE_COUNT = 300;   // 大量小文件，超过kMergeFactor
+    const size_t ELEMENTS_PER_FILE = 100;
+
+    std::cout << "\n=== 测试内存临时层 ===" << std::endl;
+
+    std::vector<int64_t> all;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        std::string file = test_dir + "/small_" + std::to_string(i) + ".dat";
+        generate_test_file(file, ELEMENTS_PER_FILE);
+        auto records = read_records<int64_t>(file);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+    // 一个大文件，它的run超过小run上限，写到磁盘
+    std::vector<int64_t> large(200000);
+    std::mt19937_64 gen(41);
+    for (auto& value : large) {
+        value = static_cast<int64_t>(gen());
+    }
+    write_records(test_dir + "/large.dat", large);
+    all.insert(all.end(), large.begin(), large.end());
+    std::sort(all.begin(), all.end());
+
+    const std::string memory_dir = test_dir + "_mem";
+    const std::string disk_dir = test_dir + "_disk";
+    auto count_files = [](const std::string& dir) {
+        size_t files = 0;
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            files += entry.is_regular_file();
+        }
+        return files;
+    };
+
+    {
+        // 预算足够：小文件的run和小的中间归并结果都在内存临时层，磁盘上只有大文件的run
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 4 * 1024 * 1024, 4);
+        sorter.setTempDirs({disk_dir});
+        sorter.setMemoryTempDir(memory_dir, 64 * 1024 * 1024);
+        auto cursor = sorter.sortedCursor();
+        EXPECT_GT(count_files(memory_dir), 0u);
+        EXPECT_EQ(1u, count_files(disk_dir));
+        EXPECT_EQ(FILE_COUNT + 1, count_files(test_dir));
+
+        std::vector<int64_t> merged, block;
+        while (cursor.next(block)) {
+            merged.insert(merged.end(), block.begin(), block.end());
+        }
+        EXPECT_EQ(all, merged);
+    }
+
+    // 预算只够一部分小run时，其余照常写到磁盘；每次排序都从完整的预算开始
+    ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 4 * 1024 * 1024, 4);
+    sorter.setTempDirs({disk_dir});
+    sorter.setMemoryTempDir(memory_dir, 100 * ELEMENTS_PER_FILE * sizeof(int64_t));
+    for (int pass = 0; pass < 2; ++pass) {
+        sorter.sort();
+        EXPECT_EQ(all, read_records<int64_t>(output_file));
+        EXPECT_EQ(0u, count_files(memory_dir));
+        EXPECT_EQ(0u, count_files(disk_dir));
+    }
+
+    fs::remove_all(memory_dir);
+    fs::remove_all(disk_dir);
+}
+
+// 测试预留空间、reflink/copy_file_range复制与单个run的移动
+TEST_F(ExternalMergeSortTest, PreallocationAndSingleRunMove) {
+    std::cout << "\n=== 测试预留空间与单个run的移动 ===" << std::endl;
+
+    auto allocated_bytes = [](const std::string& path) {
+        struct stat st;
+        EXPECT_EQ(0, ::stat(path.c_str(), &st));
+        return static_cast<uint64_t>(st.st_blocks) * 512;
+    };
+    auto no_temp_files = [this]() {
+        for (const auto& entry : fs::recursive_directory_iterator(test_dir)) {
+            if (entry.path().string().find(".sorted") != std::string::npos) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // 从开头复制部分字节到空文件，以及追加到非空文件
+    {
+        std::vector<int64_t> records(10000);
+        std::iota(records.begin(), records.end(), 0);
+        write_records(test_dir + "/source.bin", records);
+        std::ofstream(test_dir + "/target.bin", std::ios::binary).close();
+        appendFileRange(test_dir + "/source.bin", 0, 4000 * sizeof(int64_t), test_dir + "/target.bin");
+        appendFileRange(test_dir + "/source.bin", 9000 * sizeof(int64_t), 1000 * sizeof(int64_t),
+                        test_dir + "/target.bin");
+        std::vector<int64_t> expected(records.begin(), records.begin() + 4000);
+        expected.insert(expected.end(), records.begin() + 9000, records.end());
+        EXPECT_EQ(expected, read_records<int64_t>(test_dir + "/target.bin"));
+
+        moveFile(test_dir + "/target.bin", test_dir + "/moved.bin");
+        EXPECT_FALSE(fs::exists(test_dir + "/target.bin"));
+        EXPECT_EQ(expected, read_records<int64_t>(test_dir + "/moved.bin"));
+        fs::remove(test_dir + "/source.bin");
+        fs::remove(test_dir + "/moved.bin");
+    }
+
+    // 单个输入文件：多个chunk归并成一个run后直接移动为输出文件；压缩run高估了大小，预留的空间在关闭时释放
+    generate_test_file(test_dir + "/data.dat", 200000);
+    std::vector<int64_t> expected = read_records<int64_t>(test_dir + "/data.dat");
+    std::sort(expected.begin(), expected.end());
+    for (bool compress : {false, true}) {
+        ExternalMergeSorter<int64_t> sorter(test_dir, output_file, 1024 * 1024, 2);
+        sorter.setCompressRuns(compress);
+        sorter.sort();
+        EXPECT_EQ(expected, read_records<int64_t>(output_file)) << "compress=" << compress;
+        EXPECT_LE(allocated_bytes(output_file), (fs::file_size(output_file) + 4095) / 4096 * 4096);
+        EXPECT_TRUE(no_temp_files());
+    }
+
+    // 推送式输入只有一个溢写run
+    {
+        ExternalMergeSorter<int64_t> sorter("", output_file, expected.size() * sizeof(int64_t) * 3, 2);
+        sorter.add(expected);
+        sorter.finish();
+        EXPECT_EQ(expected, read_records<int64_t>(output_file));
+    }
+
+    // 变长记录只有一个run时同样移动为输出文件，不留下run
+    fs::remove(test_dir + "/data.dat");
+    std::string data;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 1000; ++i) {
+        std::string key = "key" + std::to_string((i * 7919) % 1000);
+        VarLenFormat::append(data, key, key);
+        keys.push_back(key);
+    }
+    std::ofstream(test_dir + "/var.dat", std::ios::binary) << data;
+    VarLenExternalMergeSorter sorter(test_dir, output_file, 64 * 1024 * 1024, 2);
+    sorter.sort();
+    EXPECT_TRUE(no_temp_files());
+
+    ThreadPool io_pool(1);
+    VarLenRunReader reader(output_file, io_pool, 4096);
+    std::vector<std::string> output_keys;
+    VarLenRecord record;
+    while (reader.next(record)) {
+        output_keys.emplace_back(record.key);
+    }
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(keys, output_keys);
+}